@@ -5,17 +5,29 @@
 #include "warp/entity.h"
 #include "warp/math/mat4.h"
 
-#include "core.h"
-#include "level.h"
+#include "tweens.h"
+#include "entities.h"
 
 using namespace warp;
 
+static const float BULLET_SPEED = 4.5f;
+
 class bullet_controller_t final : public controller_impl_i {
     public:
-        bullet_controller_t(const level_t *level)
-            : _level(level)
+        bullet_controller_t(vec3_t target, float duration)
+            : _owner(nullptr)
+            , _world(nullptr)
+            , _tweens()
+            , _target(target)
+            , _duration(duration)
         { }
 
+        ~bullet_controller_t() {
+            if (_tweens != nullptr) {
+                _tweens->stop(_owner, TWEEN_POSITION);
+            }
+        }
+
         dynval_t get_property(const warp_tag_t &) const override {
             return dynval_t::make_null();
         }
@@ -23,32 +35,28 @@ class bullet_controller_t final : public controller_impl_i {
         void initialize(entity_t *owner, world_t *world) override {
             _owner = owner;
             _world = world;
+            _tweens = get_tweens(world)->shared_from_this();
+
+            const tween_def_t def =
+                { TWEEN_POSITION, TWEEN_LINEAR, TWEEN_LINEAR
+                , _owner->get_position(), _target, _duration
+                };
+            _tweens->start(_owner, def, [this]() {
+                destroy_game_entity(_world, _owner);
+            });
         }
 
-        void update(float, const input_t &) override { 
-            const vec3_t pos = _owner->get_position();
-            if (_level->is_point_walkable(pos) == false) {
-                _world->destroy_later(_owner);
-            }
-        }
+        void update(float, const input_t &) override { }
 
-        void handle_message(const message_t &message) override {
-            messagetype_t type = message.type;
-            if (type == MSG_PHYSICS_COLLISION_DETECTED) {
-                const int coll_id = message.data.get_int();
-                const collision_t *coll = _world->get_physics_collision(coll_id);
-                /* TODO: passing the position does not seem to be the best idea */
-                entity_t *other = coll->other;
-                _world->broadcast_message(CORE_BULLET_HIT, other->get_position());
-                _world->destroy_later(_owner);
-            }
-        }
+        void handle_message(const message_t &) override { }
 
     private:
-        world_t  *_world;
         entity_t *_owner;
+        world_t  *_world;
+        std::shared_ptr<tween_system_t> _tweens;
 
-        const level_t *_level;
+        vec3_t _target;
+        float _duration;
 };
 
 void bullet_factory_t::initialize() {
@@ -64,8 +72,8 @@ static const char *get_texture_name(bullet_type_t type) {
 }
 
 entity_t *bullet_factory_t::create_bullet
-        ( vec3_t position, vec3_t velocity, bullet_type_t type
-        , const level_t *level
+        ( vec3_t position, vec3_t direction, float distance
+        , bullet_type_t type
         ) {
     if (_initialized == false) {
         warp_log_e("Bullet factory not initialized.");
@@ -75,22 +83,17 @@ entity_t *bullet_factory_t::create_bullet
     model_t model;
     model_init(&model, _mesh_id, _tex_id);
     position.y += 0.3f;
+    const vec3_t target = vec3_add(position, vec3_scale(direction, distance));
 
     graphics_comp_t *graphics = _world->create_graphics();
     graphics->add_model(model);
 
-    physics_comp_t *physics = _world->create_physics();
-    aabb_init(&physics->_bounds, vec3(0, 0, 0), vec3(0.2f, 0.2f, 0.2f));
-    physics->_velocity = vec3(velocity.x, 0, velocity.z);
-    physics->_gravity_scale = 0;
-
     controller_comp_t *controller = _world->create_controller();
-    controller->initialize(new bullet_controller_t(level));
+    controller->initialize(new bullet_controller_t(target, distance / BULLET_SPEED));
 
-    entity_t *entity = _world->create_entity(position, graphics, physics, controller);
+    entity_t *entity = create_game_entity(_world, position, graphics, NULL, controller);
     if (entity == NULL) {
         _world->destroy_graphics(graphics);
-        _world->destroy_physics(physics);
         _world->destroy_controller(controller);
         warp_log_e("Failed to create bullet.");
         return NULL;
@@ -99,7 +102,7 @@ entity_t *bullet_factory_t::create_bullet
     entity->set_tag(WARP_TAG("bullet"));
 
     if (type == BULLET_ARROW) {
-        const vec3_t v = vec3_normalize(velocity);
+        const vec3_t v = direction;
         quat_t quat = quat_from_direction(v, vec3(0, 1, 0), vec3(v.z, 0, -v.x));
         entity->receive_message(MSG_PHYSICS_ROTATE, quat);
     }
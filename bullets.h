@@ -4,8 +4,6 @@
 #include "warp/utils/result.h"
 #include "warp/resources/resources.h"
 
-class level_t;
-
 namespace warp {
     class entity_t;
     class world_t;
@@ -26,9 +24,11 @@ class bullet_factory_t {
 
         void initialize();
 
+        /* bullets are only shown, hits are resolved by level_state_t before
+         * they fly; the bullet is destroyed after covering distance */
         warp::entity_t *create_bullet
-            ( warp_vec3_t initial_position, warp_vec3_t velocity
-            , bullet_type_t type, const level_t *level
+            ( warp_vec3_t initial_position, warp_vec3_t direction
+            , float distance, bullet_type_t type
             );
 
     private:
@@ -1,6 +1,9 @@
 #define WARP_DROP_PREFIX
 #include "button.h"
 
+#include <memory>
+#include <vector>
+
 #include "warp/world.h"
 #include "warp/entity.h"
 #include "warp/components.h"
@@ -11,12 +14,82 @@
 
 #include "core.h"
 #include "text-label.h"
+#include "entities.h"
+#include "sleeping_controller.h"
 
 using namespace warp;
 
 static const float BUTTON_ANIM_TIME = 1.0f;
 
-class button_controller_t final : public controller_impl_i {
+class button_controller_t;
+
+/* Buttons are bucketed in a grid over the UI, so a tap is tested only
+ * against buttons in its cell. Positions outside the grid are clamped to
+ * the border cells. */
+static const float HUB_CELL_SIZE = 128.0f;
+static const int HUB_COLUMNS = 10;
+static const int HUB_ROWS = 8;
+
+static int get_hub_cell(float value, int count) {
+    const int cell = (int)floorf(value / HUB_CELL_SIZE) + count / 2;
+    return cell < 0 ? 0 : (cell >= count ? count - 1 : cell);
+}
+
+class button_hub_t final : public std::enable_shared_from_this<button_hub_t> {
+    public:
+        void add(button_controller_t *button, vec2_t pos, vec2_t size) {
+            const entry_t entry = { button, pos, size };
+            for_each_cell(pos, size, [&](std::vector<entry_t> &cell) {
+                cell.push_back(entry);
+            });
+        }
+
+        void remove(button_controller_t *button, vec2_t pos, vec2_t size) {
+            for_each_cell(pos, size, [&](std::vector<entry_t> &cell) {
+                for (auto it = cell.begin(); it != cell.end();) {
+                    it = it->button == button ? cell.erase(it) : it + 1;
+                }
+            });
+        }
+
+        /* later buttons are on top */
+        button_controller_t *find(vec2_t pos) const {
+            const int column = get_hub_cell(pos.x, HUB_COLUMNS);
+            const int row = get_hub_cell(pos.y, HUB_ROWS);
+            const std::vector<entry_t> &cell = _cells[row][column];
+            for (auto it = cell.rbegin(); it != cell.rend(); it++) {
+                const vec2_t diff = vec2_sub(pos, it->pos);
+                if (fabs(diff.x) < it->size.x * 0.5f 
+                        && fabs(diff.y) < it->size.y * 0.5f) {
+                    return it->button;
+                }
+            }
+            return NULL;
+        }
+
+    private:
+        struct entry_t {
+            button_controller_t *button;
+            vec2_t pos, size;
+        };
+
+        std::vector<entry_t> _cells[HUB_ROWS][HUB_COLUMNS];
+
+        template <typename F>
+        void for_each_cell(vec2_t pos, vec2_t size, F action) {
+            const int first_column = get_hub_cell(pos.x - size.x * 0.5f, HUB_COLUMNS);
+            const int last_column  = get_hub_cell(pos.x + size.x * 0.5f, HUB_COLUMNS);
+            const int first_row = get_hub_cell(pos.y - size.y * 0.5f, HUB_ROWS);
+            const int last_row  = get_hub_cell(pos.y + size.y * 0.5f, HUB_ROWS);
+            for (int row = first_row; row <= last_row; row++) {
+                for (int column = first_column; column <= last_column; column++) {
+                    action(_cells[row][column]);
+                }
+            }
+        }
+};
+
+class button_controller_t final : public sleeping_controller_t {
     public:
         button_controller_t
                 (vec2_t pos, vec2_t size, std::function<void(void)> handler)
@@ -24,8 +97,14 @@ class button_controller_t final : public controller_impl_i {
             , _size(size)
             , _handler(handler)
             , _timer(0)
+            , _hub()
+            , _registered(false)
         {}
 
+        ~button_controller_t() {
+            change_registration(false);
+        }
+
         dynval_t get_property(const warp_tag_t &) const override {
             return dynval_t::make_null();
         }
@@ -33,49 +112,113 @@ class button_controller_t final : public controller_impl_i {
         void initialize(entity_t *owner, world_t *world) override {
             _owner = owner;
             _world = world;
+
+            entity_t *hub = world->find_entity(WARP_TAG("button_hub"));
+            if (hub == nullptr) {
+                warp_log_e("Cannot register button, there is no button hub.");
+                return;
+            }
+            void *raw_hub = hub->get_property(WARP_TAG("hub")).get_pointer();
+            _hub = ((button_hub_t *)raw_hub)->shared_from_this();
+            change_registration(true);
         }
 
-        void update(float dt, const input_t &input) override {
-            _screen_size = input.screen_size;
+        void update_awake(float dt, const input_t &) override {
+            if (_timer <= 0) {
+                sleep();
+                return;
+            }
+            _timer -= dt;
+            const float k = ease_elastic(1 - _timer);
+            const float scale = lerp(1.4f, 1, k);
+            _owner->receive_message(MSG_PHYSICS_SCALE, vec3(scale, scale, scale));
+        }
+
+        /* hidden buttons cannot be pressed */
+        void handle_message(const message_t &message) override {
+            const messagetype_t type = message.type;
+            if (type == MSG_GRAPHICS_VISIBLITY) {
+                change_registration(message.data.get_int() != 0);
+            }
+        }
+
+        void press() {
+            _handler();
+            _timer = BUTTON_ANIM_TIME;
+            wake();
+        }
 
-            if (_timer > 0) {
-                _timer -= dt;
-                const float k = ease_elastic(1 - _timer);
-                const float scale = lerp(1.4f, 1, k);
-                _owner->receive_message(MSG_PHYSICS_SCALE, vec3(scale, scale, scale));
+    private:
+        entity_t *_owner;
+        world_t *_world;
+        vec2_t _pos, _size;
+        std::function<void(void)> _handler;
+        float _timer;
+        /* shared, so the hub outlives buttons whatever the destruction order */
+        std::shared_ptr<button_hub_t> _hub;
+        bool _registered;
+
+        void change_registration(bool registered) {
+            if (_hub == nullptr || _registered == registered) return;
+            if (registered) {
+                _hub->add(this, _pos, _size);
+            } else {
+                _hub->remove(this, _pos, _size);
             }
+            _registered = registered;
         }
+};
 
-        bool is_touching_button(vec2_t screen_pos) {
-            vec2_t pos = vec2_sub(screen_pos, vec2_scale(_screen_size, 0.5f));
-            pos.y = -pos.y;
+class button_hub_controller_t final : public controller_impl_i {
+    public:
+        button_hub_controller_t()
+            : _hub(std::make_shared<button_hub_t>())
+            , _screen_size(vec2(1, 1))
+        {}
 
-            const vec2_t diff = vec2_sub(pos, _pos);
-            return fabs(diff.x) < _size.x * 0.5f 
-                && fabs(diff.y) < _size.y * 0.5f;
+        dynval_t get_property(const warp_tag_t &name) const override {
+            if (warp_tag_equals_buffer(&name, "hub")) {
+                return (void *)_hub.get();
+            }
+            return dynval_t::make_null();
+        }
+
+        void initialize(entity_t *, world_t *) override { }
+
+        void update(float, const input_t &input) override {
+            _screen_size = input.screen_size;
         }
 
         void handle_message(const message_t &message) override {
             const messagetype_t type = message.type;
             if (type == MSG_INPUT_GESTURE_DETECTED) {
                 const gesture_t g = message.data.get_gesture();
-                if (g.kind == GESTURE_TAP 
-                        && is_touching_button(g.final_position)) {
-                    _handler();
-                    _timer = BUTTON_ANIM_TIME;
+                if (g.kind != GESTURE_TAP) return;
+
+                vec2_t pos = vec2_sub(g.final_position, vec2_scale(_screen_size, 0.5f));
+                pos.y = -pos.y;
+
+                button_controller_t *button = _hub->find(pos);
+                if (button != NULL) {
+                    button->press();
                 }
             }
         }
 
     private:
-        entity_t *_owner;
-        world_t *_world;
+        std::shared_ptr<button_hub_t> _hub;
         vec2_t _screen_size;
-        vec2_t _pos, _size;
-        std::function<void(void)> _handler;
-        float _timer;
 };
 
+extern entity_t *create_button_hub(world_t *world) {
+    controller_comp_t *controller = world->create_controller();
+    controller->initialize(new button_hub_controller_t);
+
+    entity_t *entity = create_game_entity(world, vec3(0, 0, 0), NULL, NULL, controller);
+    entity->set_tag(WARP_TAG("button_hub"));
+    return entity;
+}
+
 extern controller_comp_t *create_button_controller
         ( world_t *world, vec2_t pos, vec2_t size
         , std::function<void(void)> handler
@@ -126,7 +269,7 @@ extern entity_t *create_ui_background(world_t *world, vec4_t color) {
     }
 
     const vec3_t position = vec3(0, 0, -8);
-    entity_t *entity = world->create_entity(position, graphics, nullptr, nullptr);
+    entity_t *entity = create_game_entity(world, position, graphics, nullptr, nullptr);
     entity->set_tag(WARP_TAG("background"));
     return entity;
 }
@@ -142,7 +285,7 @@ extern entity_t *create_ui_image
         return NULL;
     }
     const vec3_t position = vec3(pos.x, pos.y, 8);
-    entity_t *entity = world->create_entity(position, graphics, NULL, NULL);
+    entity_t *entity = create_game_entity(world, position, graphics, NULL, NULL);
     entity->set_tag(WARP_TAG("image"));
     return entity;
 }
@@ -166,7 +309,7 @@ extern entity_t *create_button
     }
 
     const vec3_t position = vec3(pos.x, pos.y, 8);
-    entity_t *entity = world->create_entity(position, graphics, nullptr, controller);
+    entity_t *entity = create_game_entity(world, position, graphics, nullptr, controller);
     entity->set_tag(WARP_TAG("button"));
     return entity;
 }
@@ -188,7 +331,12 @@ class parent_controller_t final : public controller_impl_i {
         void handle_message(const message_t &message) override {
             const messagetype_t type = message.type;
             if (type == MSG_ENTITY_WILL_BE_DESTROYED) {
-                _world->destroy_later(_child);
+                destroy_game_entity(_world, _child);
+            } else if (type == MSG_GRAPHICS_VISIBLITY 
+                    || type == CORE_SHOW_POINTER_TEXT
+                    || type == CORE_SHOW_TAG_TEXT
+                    || type == CORE_SHOW_KNOWN_TEXT) {
+                _child->receive_message(type, message.data);
             }
         }
 
@@ -227,7 +375,7 @@ extern entity_t *create_text_button
     controller->add_controller(new parent_controller_t(label));
 
     const vec3_t position = vec3(pos.x, pos.y, 1);
-    entity_t *entity = world->create_entity(position, graphics, NULL, controller);
+    entity_t *entity = create_game_entity(world, position, graphics, NULL, controller);
     entity->set_tag(WARP_TAG("text-button"));
 
     return entity;
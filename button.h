@@ -12,6 +12,10 @@ namespace warp {
     class graphics_comp_t;
 }
 
+/* Tests taps against all buttons of the world at once, buttons register
+ * with it so it has to be created before them: */
+warp::entity_t *create_button_hub(warp::world_t *world);
+
 warp::controller_comp_t *create_button_controller
     ( warp::world_t *world, warp_vec2_t pos, warp_vec2_t size
     , std::function<void(void)> handler
@@ -27,6 +31,7 @@ warp::entity_t *create_button
     , std::function<void(void)> handler, const char *texture
     );
 
+/* Text and visibility messages sent to the button are passed to its label: */
 warp::entity_t *create_text_button
     ( warp::world_t *world, warp_vec2_t pos, warp_vec2_t size
     , std::function<void(void)> handler, const char *text
@@ -10,6 +10,9 @@
 
 #include "core.h"
 #include "objects_ai.h"
+#include "message_bus.h"
+#include "entities.h"
+#include "tweens.h"
 
 using namespace warp;
 
@@ -31,17 +34,6 @@ enum movement_state_t : unsigned int {
     MOVE_FALLING,
 };
 
-enum rotation_state_t : unsigned int {
-    ROATE_IDLE = 0,
-    ROATE_ROTATING,
-};
-
-enum health_state_t : unsigned int {
-    HEAL_IDLE = 0,
-    HEAL_DYING,
-    HEAL_HURT,
-};
-
 static float get_time_for_char_state(movement_state_t state) {
     switch (state) {
         case MOVE_MOVING:    return MOVE_MOVE_TIME;
@@ -52,37 +44,24 @@ static float get_time_for_char_state(movement_state_t state) {
     }
 }
 
-static float get_time_for_rotate_state(rotation_state_t state) {
-    switch (state) {
-        case ROATE_ROTATING: return ROTATE_ROTATION_TIME;
-        default: return 0;
-    }
-}
-
-static float get_time_for_heal_state(health_state_t state) {
-    switch (state) {
-        case HEAL_DYING: return HEAL_DYING_TIME;
-        case HEAL_HURT:  return HEAL_HURT_TIME;
-        default: return 0;
-    }
-}
-
+/* animations are run by the tween system, controllers only start them */
 class movement_controller_t final : public controller_impl_i {
     public:
-        movement_controller_t(bool confirm_move)
+        movement_controller_t()
             : _owner(nullptr)
             , _world(nullptr)
-            , _timer(0)
-            , _state(MOVE_IDLE)
-            , _confirm(confirm_move)
-        {
-            _target_pos = vec3(0, 0, 0);
-            _old_pos = vec3(0, 0, 0);
+            , _tweens()
+        { }
+
+        ~movement_controller_t() {
+            if (_tweens != nullptr) {
+                _tweens->stop_all(_owner);
+            }
         }
 
         dynval_t get_property(const warp_tag_t &name) const override {
             if (warp_tag_equals_buffer(&name, "avat.is_idle")) {
-                return (int)(_state == MOVE_IDLE);
+                return (int)(_tweens->is_running(_owner, TWEEN_POSITION) == false);
             }
             return dynval_t::make_null();
         }
@@ -90,33 +69,10 @@ class movement_controller_t final : public controller_impl_i {
         void initialize(entity_t *owner, world_t *world) override {
             _owner = owner;
             _world = world;
-
-            _target_pos = _old_pos = _owner->get_position();
+            _tweens = get_tweens(world)->shared_from_this();
         }
 
-        void update(float dt, const input_t &) override { 
-            if (_timer <= 0) {
-                _timer = 0;
-                if (_state != MOVE_IDLE && _confirm) {
-                    _world->broadcast_message(CORE_MOVE_DONE, 0);
-                }
-                _state = MOVE_IDLE;
-                return;
-            } 
-
-            _timer -= dt;
-            const float t = _timer / get_time_for_char_state(_state);
-
-            if (_state == MOVE_MOVING) {
-                update_movement(t);
-            } else if (_state == MOVE_BOUNCING) {
-                update_bouncing(t);
-            } else if (_state == MOVE_ATTACKING) {
-                update_attacking(t);
-            } else if (_state == MOVE_FALLING) {
-                update_falling(t);
-            }
-        }
+        void update(float, const input_t &) override { }
 
         void handle_message(const message_t &message) override {
             const messagetype_t type = message.type;
@@ -141,52 +97,37 @@ class movement_controller_t final : public controller_impl_i {
     private:
         entity_t *_owner;
         world_t *_world;
-        float _timer;
-        movement_state_t _state;
-        bool _confirm;
-
-        vec3_t _target_pos;
-        vec3_t _old_pos;
+        /* shared, controllers and the tweens are destroyed in any order */
+        std::shared_ptr<tween_system_t> _tweens;
 
         void move_immediate(vec3_t pos) {
+            _tweens->stop(_owner, TWEEN_POSITION);
             _owner->receive_message(MSG_PHYSICS_MOVE, pos);
-            _target_pos = pos;
-            _old_pos = pos;
-            _timer = 0;
         }
 
         void change_state(movement_state_t state, vec3_t target) {
-            _state = state;
-            _timer = get_time_for_char_state(state);
-            _old_pos = _owner->get_position();
-            _target_pos = target;
-        }
-
-        void update_movement(float t) {
-            const vec3_t position = vec3_lerp(_target_pos, _old_pos, t);
-            _owner->receive_message(MSG_PHYSICS_MOVE, position);
-        }
-
-        void update_bouncing(float t) {
-            const float k = sin(t * 2 * PI) * 0.15f;
-            const vec3_t position = vec3_lerp(_old_pos, _target_pos, k);
-            _owner->receive_message(MSG_PHYSICS_MOVE, position);
-        }
-
-        void update_attacking(float t) {
-            const float k = sin(t * PI) * 0.5f;
-            vec3_t position = vec3_lerp(_old_pos, _target_pos, k);
-            position.y = fabs(sin(t * 2 * PI)) * 0.4f;
-            _owner->receive_message(MSG_PHYSICS_MOVE, position);
-        }
-
-        void update_falling(float t) {
-            const float k = ease_elastic(t);
-            const float target_y = lerp(-0.5f, 0, k);
+            const vec3_t position = _owner->get_position();
+            tween_def_t def =
+                { TWEEN_POSITION, TWEEN_LINEAR, TWEEN_LINEAR
+                , position, target, get_time_for_char_state(state)
+                };
+
+            if (state == MOVE_BOUNCING) {
+                def.curve = def.y_curve = TWEEN_WAVE;
+                def.to = vec3_lerp(position, target, -0.15f);
+            } else if (state == MOVE_ATTACKING) {
+                def.curve = TWEEN_PULSE;
+                def.y_curve = TWEEN_HOP;
+                def.to = vec3_lerp(position, target, 0.5f);
+                def.from.y = 0;
+                def.to.y = 0.4f;
+            } else if (state == MOVE_FALLING) {
+                def.y_curve = TWEEN_ELASTIC_OUT;
+                def.from.y = 0;
+                def.to.y = -0.5f;
+            }
 
-            vec3_t position = vec3_lerp(_target_pos, _old_pos, t);
-            position.y = target_y;
-            _owner->receive_message(MSG_PHYSICS_MOVE, position);
+            _tweens->start(_owner, def);
         }
 };
 
@@ -195,12 +136,16 @@ class rotation_controller_t final : public controller_impl_i {
         rotation_controller_t()
             : _owner(nullptr)
             , _world(nullptr)
-            , _timer(0)
-            , _state(ROATE_IDLE)
-            , _old_dir(DIR_Z_MINUS)
-            , _new_dir(DIR_Z_MINUS)
+            , _tweens()
+            , _dir(DIR_Z_MINUS)
         { }
 
+        ~rotation_controller_t() {
+            if (_tweens != nullptr) {
+                _tweens->stop(_owner, TWEEN_YAW);
+            }
+        }
+
         dynval_t get_property(const warp_tag_t &) const override {
             return dynval_t::make_null();
         }
@@ -208,68 +153,46 @@ class rotation_controller_t final : public controller_impl_i {
         void initialize(entity_t *owner, world_t *world) override {
             _owner = owner;
             _world = world;
-        }
+            _tweens = get_tweens(world)->shared_from_this();
 
-        void update(float dt, const input_t &) override { 
-            if (_timer <= 0) {
-                _timer = 0;
-                _state = ROATE_IDLE;
-                set_angle(dir_to_angle(_new_dir));
-                return;
-            } 
-
-            _timer -= dt;
-            const float t = _timer / get_time_for_rotate_state(_state);
-
-            if (_state == ROATE_ROTATING) {
-                update_rotating(t);
-            }
+            const quat_t quat = quat_from_euler(0, dir_to_angle(_dir) + PI, 0);
+            _owner->receive_message(MSG_PHYSICS_ROTATE, quat);
         }
 
+        void update(float, const input_t &) override { }
+
         void handle_message(const message_t &message) override {
             const messagetype_t type = message.type;
             if (type == CORE_DO_ROTATE) {
                 const dir_t dir = (dir_t) message.data.get_int();
-                change_state(ROATE_ROTATING, dir);
+                rotate(dir);
             }
         }
 
     private:
         entity_t *_owner;
         world_t *_world;
-        float _timer;
-        rotation_state_t _state;
-
-        dir_t _old_dir;
-        dir_t _new_dir;
+        std::shared_ptr<tween_system_t> _tweens;
+        dir_t _dir;
 
-        void change_state(rotation_state_t state, dir_t new_dir) {
-            _state = state;
-            _timer = get_time_for_rotate_state(state);
-            _old_dir = _new_dir;
-            _new_dir = new_dir;
-        }
-
-        void update_rotating(float t) {
-            float old_angle = dir_to_angle(_old_dir);
-            float new_angle = dir_to_angle(_new_dir);
+        void rotate(dir_t new_dir) {
+            float old_angle = dir_to_angle(_dir);
+            float new_angle = dir_to_angle(new_dir);
+            _dir = new_dir;
 
             float diff = new_angle - old_angle;
             if (diff > PI * 1.1f) {
                 old_angle += 2 * PI;
-                diff = new_angle - old_angle;
             } else if (diff < -PI * 1.1f) {
                 old_angle -= 2 * PI;
-                diff = new_angle - old_angle;
             }
-            
-            const float k = ease_cubic(1 - t);
-            set_angle(old_angle + k * diff);
-        }
 
-        void set_angle(float angle) {
-            const quat_t quat = quat_from_euler(0, angle + PI, 0);
-            _owner->receive_message(MSG_PHYSICS_ROTATE, quat);
+            const tween_def_t def =
+                { TWEEN_YAW, TWEEN_CUBIC, TWEEN_CUBIC
+                , vec3(old_angle + PI, 0, 0), vec3(new_angle + PI, 0, 0)
+                , ROTATE_ROTATION_TIME
+                };
+            _tweens->start(_owner, def);
         }
 };
 
@@ -278,10 +201,15 @@ class health_controller_t final : public controller_impl_i {
         health_controller_t()
             : _owner(nullptr)
             , _world(nullptr)
-            , _timer(0)
-            , _state(HEAL_IDLE)
+            , _tweens()
         { }
 
+        ~health_controller_t() {
+            if (_tweens != nullptr) {
+                _tweens->stop(_owner, TWEEN_SCALE);
+            }
+        }
+
         dynval_t get_property(const warp_tag_t &) const override {
             return dynval_t::make_null();
         }
@@ -289,65 +217,48 @@ class health_controller_t final : public controller_impl_i {
         void initialize(entity_t *owner, world_t *world) override {
             _owner = owner;
             _world = world;
+            _tweens = get_tweens(world)->shared_from_this();
         }
 
-        void update(float dt, const input_t &) override { 
-            if (_timer <= 0) {
-                if (_state == HEAL_DYING) {
-                    _world->destroy_later(_owner);
-                }
-                _timer = 0;
-                _state = HEAL_IDLE;
-                return;
-            } 
-
-            _timer -= dt;
-            const float t = _timer / get_time_for_heal_state(_state);
-
-            if (_state == HEAL_DYING) {
-                update_dying(t);
-            } else if (_state == HEAL_HURT) {
-                update_hurt(t);
-            }
-        }
+        void update(float, const input_t &) override { }
 
         void handle_message(const message_t &message) override {
             const messagetype_t type = message.type;
             if (type == CORE_DO_DIE) {
-                change_state(HEAL_DYING);
+                die();
             } else if (type == CORE_DO_HURT) {
-                change_state(HEAL_HURT);
+                hurt();
             }
         }
 
     private:
         entity_t *_owner;
         world_t *_world;
-        float _timer;
-        health_state_t _state;
-
-        void change_state(health_state_t state) {
-            _state = state;
-            _timer = get_time_for_heal_state(state);
-        }
-
-        void update_dying(float t) {
-            const float scale = sin(t * PI * 0.5f);
-            const vec3_t scales = vec3(scale, scale, scale);
-            _owner->receive_message(MSG_PHYSICS_SCALE, scales);
+        std::shared_ptr<tween_system_t> _tweens;
+
+        void die() {
+            const tween_def_t def =
+                { TWEEN_SCALE, TWEEN_SINE_IN, TWEEN_SINE_IN
+                , vec3(1, 1, 1), vec3(0, 0, 0), HEAL_DYING_TIME
+                };
+            _tweens->start(_owner, def, [this]() {
+                destroy_game_entity(_world, _owner);
+            });
         }
 
-        void update_hurt(float t) {
-            const float scale = 1 - sin(t * PI) * 0.3f;
-            const vec3_t scales = vec3(scale, scale, scale);
-            _owner->receive_message(MSG_PHYSICS_SCALE, scales);
+        void hurt() {
+            const tween_def_t def =
+                { TWEEN_SCALE, TWEEN_PULSE, TWEEN_PULSE
+                , vec3(1, 1, 1), vec3(0.7f, 0.7f, 0.7f), HEAL_HURT_TIME
+                };
+            _tweens->start(_owner, def);
         }
 };
 
 class ai_controller_t final : public controller_impl_i {
     public:
         ai_controller_t(obj_id_t id)
-            : _owner(NULL), _world(NULL), _id(id) { }
+            : _owner(NULL), _world(NULL), _bus(NULL), _id(id) { }
 
         dynval_t get_property(const warp_tag_t &) const override {
             return dynval_t::make_null();
@@ -356,6 +267,7 @@ class ai_controller_t final : public controller_impl_i {
         void initialize(entity_t *owner, world_t *world) override {
             _owner = owner;
             _world = world;
+            _bus = get_message_bus(world);
             _rand = warp_random_create(209); /* TODO: temporary! */
             _state_initialized = false;
         }
@@ -370,7 +282,7 @@ class ai_controller_t final : public controller_impl_i {
                     _state_initialized = true;
                 }
                 if (pick_next_command(&_cmd, _id, &_state, st, _rand)) {
-                    _world->broadcast_message(CORE_AI_COMMAND, (void *)&_cmd);
+                    _bus->publish(CORE_AI_COMMAND, (void *)&_cmd);
                 }
             }
         }
@@ -378,6 +290,7 @@ class ai_controller_t final : public controller_impl_i {
     private:
         entity_t *_owner;
         world_t *_world;
+        message_bus_t *_bus;
         warp_random_t *_rand;
         obj_id_t _id;
         command_t _cmd;
@@ -389,7 +302,7 @@ class ai_controller_t final : public controller_impl_i {
 extern controller_comp_t *create_character_controller
         (world_t *world, obj_id_t id, bool is_player) {
     controller_comp_t *controller = world->create_controller();
-    controller->initialize(new movement_controller_t(is_player));
+    controller->initialize(new movement_controller_t);
     controller->add_controller(new rotation_controller_t);
     controller->add_controller(new health_controller_t);
     if (is_player == false) {
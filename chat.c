@@ -2,319 +2,115 @@
 #include "chat.h"
 
 #include "warp/utils/io.h"
-#include "warp/utils/tokenizer.h"
 #include "warp/resources/resources.h"
 #include "libs/parson/parson.h"
 #include "game-resources.h"
+#include "facts.h"
+#include "trace.h"
 
 static const char *DATA_DIR = "assets/data";
 
-/* predicate: */
+/* predicates and side effects: */
 
-enum pred_op {
-    EQ = 0, NEQ, GT, GTE, LT, LTE
-};
-
-struct arg {
-    bool is_literal;
-    union {
-        int literal_value;
-        warp_str_t fact_name;
-    };
-};
-
-struct predicate {
-    enum   pred_op op;
-    struct arg     arg1;  
-    struct arg     arg2;  
-};
-
-typedef bool (*pred_operation)(int a, int b);
-
-static bool equals          (int a, int b) { return a == b; }
-static bool not_equals      (int a, int b) { return a != b; }
-static bool greater_than    (int a, int b) { return a >  b; }
-static bool greater_or_equal(int a, int b) { return a >= b; }
-static bool lower_than      (int a, int b) { return a <  b; }
-static bool lower_or_equal  (int a, int b) { return a <= b; }
-
-pred_operation operations[] = {
-    [EQ]  = equals,
-    [NEQ] = not_equals,
-    [GT]  = greater_than,
-    [GTE] = greater_or_equal,
-    [LT]  = lower_than,
-    [LTE] = lower_or_equal,
-};
-
-bool parse_operator(enum pred_op *op, tokenizer_t *tok) {
-    if (token_equals(tok, "==")) {
-        *op = EQ;
-        return true;
-    } else if (token_equals(tok, "!=")) {
-        *op = NEQ;
-        return true;
-    } else if (token_equals(tok, ">")) {
-        *op = GT;
-        return true;
-    } else if (token_equals(tok, ">=")) {
-        *op = GTE;
-        return true;
-    } else if (token_equals(tok, "<")) {
-        *op = LT;
-        return true;
-    } else if (token_equals(tok, "<=")) {
-        *op = LTE;
-        return true;
+extern void chat_entry_evaluate_side_effects
+        (const chat_t *chat, const chat_entry_t *entry, fact_set_t *facts) {
+    if (entry->side_effect == CHAT_CODE_NONE) {
+        return;
     }
-    return false;
+    const chat_instruction_t *code = warp_array_get(&chat->code, entry->side_effect);
+    chat_run_side_effects(code, facts);
 }
 
-bool parse_argument(struct arg *arg, tokenizer_t *tok) {
-    if (token_is_int(tok)) {
-        arg->is_literal = true;
-        token_parse_int(tok, &arg->literal_value);
-        return true;
-    } else if (token_equals(tok, "true")) {
-        arg->is_literal = true;
-        arg->literal_value = 1;
-        return true;
-    } else if (token_equals(tok, "false")) {
-        arg->is_literal = true;
-        arg->literal_value = 0;
+static bool evaluate_predicate
+        (const chat_t *chat, const chat_entry_t *entry, const fact_set_t *facts) {
+    if (entry->predicate == CHAT_CODE_NONE) {
         return true;
-    } else {
-        arg->is_literal = false;
-        arg->fact_name = token_parse_string(tok, false);
-        return true;
-    }
-    return false;
-}
-
-warp_result_t parse_predicate(struct predicate *p, const char *str) {
-    tokenizer_t tok;
-    tokenizer_init(&tok, str, " ");
-    memset(p, 0, sizeof *p);
-    
-    token_next(&tok, '\0');
-    if (parse_argument(&p->arg1, &tok) == false) {
-        char buffer[64];
-        token_copy(&tok, buffer, 64);
-        return warp_failure("Failed to parse '%s' as first predicate argument", buffer);
-    }
-
-    token_next(&tok, '\0');
-    if (parse_operator(&p->op, &tok) == false) {
-        char buffer[64];
-        token_copy(&tok, buffer, 64);
-        return warp_failure("Failed to parse '%s' as predicate operator", buffer);
-    }
-
-    token_next(&tok, '\0');
-    if (parse_argument(&p->arg2, &tok) == false) {
-        char buffer[64];
-        token_copy(&tok, buffer, 64);
-        return warp_failure("Failed to parse '%s' as second predicate argument.", buffer);
-    }
-
-    if (token_next(&tok, '\0')) {
-        warp_log_d("Predicate '%s' has some unexpected tokens that were ignored.", str);
-    }
-
-    return warp_success();
-}
-
-static void destroy_argument(struct arg *a) {
-    if (a->is_literal == false) {
-        warp_str_destroy(&a->fact_name);
     }
+    const chat_instruction_t *code = warp_array_get(&chat->code, entry->predicate);
+    return chat_run_predicate(code, facts);
 }
 
-static void destroy_predicate(struct predicate *p) {
-    if (p == NULL) return;
-    destroy_argument(&p->arg1);
-    destroy_argument(&p->arg2);
-}
-
-static int get_fact(const char *name, const warp_map_t *facts) {
-    if (warp_map_has_key(facts, name)) {
-        return warp_map_get_value(int, facts, name);
-    }
-    return 0;
-}
+/* rest of the chat: */
 
-static int evaluate_argument(const struct arg *arg, const warp_map_t *facts) {
-    if (arg->is_literal) {
-        return arg->literal_value;
-    }
-    const char *name = warp_str_value(&arg->fact_name);
-    return get_fact(name, facts);
+static void destroy_response(response_t *resp) {
+    warp_str_destroy(&resp->text);
 }
 
-static bool evaluate_predicate(const struct predicate *p, const warp_map_t *facts) {
-    if (p == NULL) { 
-        return true; 
+static void destroy_entry(void *raw_entry) {
+    chat_entry_t *entry = raw_entry;
+    warp_str_destroy(&entry->text);
+    for (size_t i = 0; i < MAX_CHAT_RESPONSES_COUNT; i++) {
+        destroy_response(&entry->responses[i]);
     }
-    const int a = evaluate_argument(&p->arg1, facts);
-    const int b = evaluate_argument(&p->arg2, facts);
-    return operations[p->op](a, b);
 }
 
-/* side effects: */
-
-enum side_op {
-    MUT = 0, INC, DEC
+enum predicate_result {
+    PREDICATE_UNKNOWN = 0, PREDICATE_FALSE, PREDICATE_TRUE
 };
 
-struct side_effect {
-    enum side_op op;
-    struct arg   arg1;
-    struct arg   arg2;
-};
-
-typedef void (*side_operation)(const char *name, int value, warp_map_t *facts);
-
-void mutate(const char *name, int value, warp_map_t *facts) {
-    warp_map_insert(facts, name, &value);
-}
-
-void increment(const char *name, int value, warp_map_t *facts) {
-    const int result = get_fact(name, facts) + value;
-    warp_map_insert(facts, name, &result);
-}
-
-void decrement(const char *name, int value, warp_map_t *facts) {
-    const int result = get_fact(name, facts) - value;
-    warp_map_insert(facts, name, &result);
+extern void chat_cache_init
+        (chat_cache_t *cache, const chat_t *chat, const fact_set_t *facts) {
+    const size_t count = warp_array_get_size(&chat->entries);
+    cache->chat = chat;
+    cache->facts = facts;
+    cache->synced_stamp = facts->stamp;
+    cache->results = calloc(count, sizeof *cache->results);
 }
 
-side_operation side_operations[] = {
-    [MUT] = mutate,
-    [INC] = increment,
-    [DEC] = decrement,
-};
-
-bool parse_side_operator(enum side_op *op, tokenizer_t *tok) {
-    if (token_equals(tok, "<-")) {
-        *op = MUT;
-        return true;
-    } else if (token_equals(tok, "+=")) {
-        *op = INC;
-        return true;
-    } else if (token_equals(tok, "-=")) {
-        *op = DEC;
-        return true;
-    }
-    return false;
+extern void chat_cache_destroy(chat_cache_t *cache) {
+    if (cache == NULL) return;
+    free(cache->results);
+    cache->results = NULL;
 }
 
-static warp_result_t parse_side_effect(struct side_effect *se, const char *str) {
-    tokenizer_t tok;
-    tokenizer_init(&tok, str, " ");
-    memset(se, 0, sizeof *se);
-    
-    token_next(&tok, '\0');
-    if (parse_argument(&se->arg1, &tok) == false) {
-        char buffer[64];
-        token_copy(&tok, buffer, 64);
-        return warp_failure("Failed to parse '%s' as side effect's fact.", buffer);
-    }
-    if (se->arg1.is_literal) {
-        return warp_failure( "Cannot use '%d' value as side effect's fact."
-                           , se->arg1.literal_value
-                           );
-    }
-
-    token_next(&tok, '\0');
-    if (parse_side_operator(&se->op, &tok) == false) {
-        char buffer[64];
-        token_copy(&tok, buffer, 64);
-        return warp_failure("Failed to parse '%s' as side effect operator.", buffer);
-    }
+/* forgets results of predicates reading facts changed since last sync */
+static void sync_cache(chat_cache_t *cache) {
+    const fact_set_t *facts = cache->facts;
+    if (facts->stamp == cache->synced_stamp) return;
 
-    token_next(&tok, '\0');
-    if (parse_argument(&se->arg2, &tok) == false) {
-        char buffer[64];
-        token_copy(&tok, buffer, 64);
-        return warp_failure("Failed to parse '%s' as side effect value.", buffer);
-    }
+    const chat_t *chat = cache->chat;
+    for (size_t i = 0; i < chat->watched_count; i++) {
+        const chat_watch_t *watch = chat->watched + i;
+        if (fact_set_get_stamp(facts, watch->fact) <= cache->synced_stamp) continue;
 
-    if (token_next(&tok, '\0')) {
-        warp_log_d("Predicate '%s' has some unexpected tokens that were ignored.", str);
+        for (uint32_t j = 0; j < watch->dependents.count; j++) {
+            const uint32_t entry = chat->dependents[watch->dependents.first + j];
+            cache->results[entry] = PREDICATE_UNKNOWN;
+        }
     }
-
-    return warp_success();
-}
-
-static void destroy_side_effect(struct side_effect *se) {
-    if (se == NULL) return;
-    destroy_argument(&se->arg1);
-    destroy_argument(&se->arg2);
+    cache->synced_stamp = facts->stamp;
 }
 
-extern void chat_entry_evaluate_side_effects
-        (const chat_entry_t *entry, warp_map_t *facts) {
-    if (entry->side_effect == NULL) {
-        return;
+static bool check_predicate(chat_cache_t *cache, uint32_t index) {
+    uint8_t *result = cache->results + index;
+    if (*result == PREDICATE_UNKNOWN) {
+        const chat_t *chat = cache->chat;
+        const chat_entry_t *entry = warp_array_get(&chat->entries, index);
+        const bool value = evaluate_predicate(chat, entry, cache->facts);
+        *result = value ? PREDICATE_TRUE : PREDICATE_FALSE;
     }
-    struct side_effect *se = entry->side_effect;
-    const char *fact = warp_str_value(&se->arg1.fact_name);
-    const int value  = evaluate_argument(&se->arg2, facts);
-    side_operations[se->op](fact, value, facts);
+    return *result == PREDICATE_TRUE;
 }
 
-/* rest of the chat: */
+/* reservoir sampling, every qualifying entry is picked with equal chance
+ * without collecting them first */
+static const chat_entry_t *pick_entry
+        (chat_cache_t *cache, warp_random_t *rand, chat_range_t range) {
+    const chat_t *chat = cache->chat;
+    sync_cache(cache);
 
-static void destroy_response(response_t *resp) {
-    warp_str_destroy(&resp->text);
-}
+    const chat_entry_t *picked = NULL;
+    int qualifying_count = 0;
+    for (uint32_t i = 0; i < range.count; i++) {
+        const uint32_t index = chat->index[range.first + i];
+        if (check_predicate(cache, index) == false) continue;
 
-static void destroy_entry(void *raw_entry) {
-    chat_entry_t *entry = raw_entry;
-    warp_str_destroy(&entry->text);
-    for (size_t i = 0; i < MAX_CHAT_RESPONSES_COUNT; i++) {
-        destroy_response(&entry->responses[i]);
-    }
-
-    destroy_predicate(entry->predicate);
-    free(entry->predicate);
-
-    destroy_side_effect(entry->side_effect);
-    free(entry->side_effect);
-}
-
-static const chat_entry_t *find_entry
-        ( const chat_t *chat, warp_random_t *rand
-        , const warp_map_t *facts
-        , bool (*condition)(void *, const chat_entry_t *)
-        , void *condition_context
-        ) {
-    warp_array_t indices = warp_array_create_typed(size_t, 16, NULL);
-    const size_t count = warp_array_get_size(&chat->entries);
-    for (size_t i = 0; i < count; i++) {
-        const chat_entry_t *entry = warp_array_get(&chat->entries, i);
-        const bool meets_prerequsites = evaluate_predicate(entry->predicate, facts); 
-        const bool condition_is_true  = condition(condition_context, entry);
-        if (meets_prerequsites && condition_is_true) {
-            warp_array_append_value(size_t, &indices, i);
+        qualifying_count += 1;
+        if (warp_random_from_range(rand, 0, qualifying_count - 1) == 0) {
+            picked = warp_array_get(&chat->entries, index);
         }
     }
-
-    const size_t selected = warp_random_index(rand, &indices);
-    const size_t index = warp_array_get_value(size_t, &indices, selected);
-
-    const chat_entry_t *entry = warp_array_get(&chat->entries, index);
-    return entry;
-}
-
-static bool is_start(void *ctx, const chat_entry_t *e) {
-    (void)ctx;
-    return e->can_start;
-}
-
-static bool has_id(void *ctx, const chat_entry_t *e) {
-    const warp_tag_t *id = ctx;
-    return warp_tag_equals(&e->id, id);
+    return picked;
 }
 
 #define RETURN_IF_NULL(arg, ret) \
@@ -324,21 +120,29 @@ static bool has_id(void *ctx, const chat_entry_t *e) {
     } \
 
 extern const chat_entry_t *get_start_entry
-        (const chat_t *chat, warp_random_t *rand, const warp_map_t *facts) {
-    RETURN_IF_NULL(chat, NULL);
+        (chat_cache_t *cache, warp_random_t *rand) {
+    RETURN_IF_NULL(cache, NULL);
     RETURN_IF_NULL(rand, NULL);
-    RETURN_IF_NULL(facts, NULL);
-    return find_entry(chat, rand, facts, is_start, NULL);
+    const chat_entry_t *entry = pick_entry(cache, rand, cache->chat->starts);
+    if (entry == NULL) {
+        warp_log_e("Chat has no start entry that meets its predicate.");
+    }
+    return entry;
 }
 
 extern const chat_entry_t *get_entry
-        ( const chat_t *chat, warp_random_t *rand, const warp_map_t *facts
-        , warp_tag_t id
-        ) {
-    RETURN_IF_NULL(chat, NULL);
+        (chat_cache_t *cache, warp_random_t *rand, warp_tag_t id) {
+    RETURN_IF_NULL(cache, NULL);
     RETURN_IF_NULL(rand, NULL);
-    RETURN_IF_NULL(facts, NULL);
-    return find_entry(chat, rand, facts, has_id, &id);
+    const chat_range_t *range = warp_map_tag_get(&cache->chat->ids, id);
+    const chat_entry_t *entry = NULL;
+    if (range != NULL) {
+        entry = pick_entry(cache, rand, *range);
+    }
+    if (entry == NULL) {
+        warp_log_e("Chat has no entry with given id that meets its predicate.");
+    }
+    return entry;
 }
 
 static bool has_json_member(const JSON_Object *o, const char *member_name) {
@@ -381,46 +185,126 @@ static warp_result_t parse_responses
     return warp_success();
 }
 
+typedef struct dependency {
+    fact_id_t fact;
+    uint32_t entry;
+} dependency_t;
+
 static warp_result_t parse_entry_predicate
-        (chat_entry_t *entry, const JSON_Object *raw_entry) {
-    entry->predicate = NULL;
+        ( chat_t *chat, const JSON_Object *raw_entry, uint32_t entry_index
+        , uint32_t *start, warp_array_t *dependencies
+        ) {
+    *start = CHAT_CODE_NONE;
     if (has_json_member(raw_entry, "predicate") == false) {
         return warp_success();
     }
-    
-    struct predicate *pred = malloc(sizeof *pred);
-    const char *str = json_object_get_string(raw_entry, "predicate");
-    warp_result_t result = parse_predicate(pred, str);
-    if (WARP_FAILED(result)) {
-        free(pred);
-        return result;
+    const char *source = json_object_get_string(raw_entry, "predicate");
+
+    warp_array_t facts = warp_array_create_typed(fact_id_t, 4, NULL);
+    warp_result_t result = chat_compile_predicate
+        (&chat->code, source, start, &facts, fact_get_shared_names());
+    for (size_t i = 0; i < warp_array_get_size(&facts); i++) {
+        dependency_t dependency;
+        dependency.fact = warp_array_get_value(fact_id_t, &facts, i);
+        dependency.entry = entry_index;
+        warp_array_append(dependencies, &dependency, 1);
     }
-    
-    entry->predicate = pred;
-    return warp_success();
+    warp_array_destroy(&facts);
+    return result;
 }
 
 static warp_result_t parse_entry_side_effect
-        (chat_entry_t *entry, const JSON_Object *raw_entry) {
-    entry->side_effect = NULL;
+        (chat_t *chat, const JSON_Object *raw_entry, uint32_t *start) {
+    *start = CHAT_CODE_NONE;
     if (has_json_member(raw_entry, "sideEffect") == false) {
         return warp_success();
     }
-    
-    struct side_effect *se = malloc(sizeof *se);
-    const char *str = json_object_get_string(raw_entry, "sideEffect");
-    warp_result_t result = parse_side_effect(se, str);
-    if (WARP_FAILED(result)) {
-        free(se);
-        return result;
+    const char *source = json_object_get_string(raw_entry, "sideEffect");
+    return chat_compile_side_effects
+        (&chat->code, source, start, fact_get_shared_names());
+}
+
+static int compare_dependencies(const void *raw_a, const void *raw_b) {
+    const dependency_t *a = raw_a;
+    const dependency_t *b = raw_b;
+    if (a->fact != b->fact) return a->fact < b->fact ? -1 : 1;
+    return a->entry < b->entry ? -1 : (a->entry > b->entry ? 1 : 0);
+}
+
+/* groups dependencies by fact, so a changed fact gives range of entries
+ * whose predicates read it */
+static void build_watches(chat_t *chat, warp_array_t *dependencies) {
+    const size_t count = warp_array_get_size(dependencies);
+    chat->watched = calloc(count, sizeof *chat->watched);
+    chat->watched_count = 0;
+    chat->dependents = calloc(count, sizeof *chat->dependents);
+    if (count == 0) return;
+
+    dependency_t *sorted = warp_array_get(dependencies, 0);
+    qsort(sorted, count, sizeof *sorted, compare_dependencies);
+
+    for (size_t i = 0; i < count; i++) {
+        chat->dependents[i] = sorted[i].entry;
+        if (i == 0 || sorted[i].fact != sorted[i - 1].fact) {
+            chat_watch_t *watch = chat->watched + chat->watched_count++;
+            watch->fact = sorted[i].fact;
+            watch->dependents.first = i;
+            watch->dependents.count = 0;
+        }
+        chat->watched[chat->watched_count - 1].dependents.count += 1;
+    }
+}
+
+#define RANGE_UNPLACED ((uint32_t)-1)
+
+/* index lists start entries first and then entries grouped by id, ranges
+ * are filled in three passes: counts, offsets and indices */
+static void build_index(chat_t *chat) {
+    const size_t count = warp_array_get_size(&chat->entries);
+    chat->ids = warp_map_create_typed(chat_range_t, NULL);
+    chat->starts.first = 0;
+    chat->starts.count = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        const chat_entry_t *entry = warp_array_get(&chat->entries, i);
+        chat->starts.count += entry->can_start ? 1 : 0;
+
+        chat_range_t *range = warp_map_tag_get(&chat->ids, entry->id);
+        if (range == NULL) {
+            const chat_range_t unplaced = { RANGE_UNPLACED, 1 };
+            warp_map_tag_insert(&chat->ids, entry->id, &unplaced);
+        } else {
+            range->count += 1;
+        }
+    }
+
+    chat->index = calloc(chat->starts.count + count, sizeof *chat->index);
+
+    uint32_t offset = chat->starts.count;
+    for (size_t i = 0; i < count; i++) {
+        const chat_entry_t *entry = warp_array_get(&chat->entries, i);
+        chat_range_t *range = warp_map_tag_get(&chat->ids, entry->id);
+        if (range->first == RANGE_UNPLACED) {
+            range->first = offset;
+            offset += range->count;
+            range->count = 0;
+        }
+    }
+
+    uint32_t starts_count = 0;
+    for (size_t i = 0; i < count; i++) {
+        const chat_entry_t *entry = warp_array_get(&chat->entries, i);
+        if (entry->can_start) {
+            chat->index[starts_count++] = i;
+        }
+        chat_range_t *range = warp_map_tag_get(&chat->ids, entry->id);
+        chat->index[range->first + range->count++] = i;
     }
-    
-    entry->side_effect = se;
-    return warp_success();
 }
 
 static warp_result_t parse(chat_t *chat, const JSON_Object *root) {
     chat->entries = warp_array_create_typed(chat_entry_t, 16, destroy_entry);
+    chat->code = warp_array_create_typed(chat_instruction_t, 64, NULL);
 
     const char *portrait = json_object_get_string(root, "defaultPortrait");
     if (portrait == NULL) {
@@ -428,10 +312,12 @@ static warp_result_t parse(chat_t *chat, const JSON_Object *root) {
     }
     chat->default_portrait = WARP_STR(portrait);
 
+    warp_array_t dependencies = warp_array_create_typed(dependency_t, 16, NULL);
+
     const JSON_Array *entries = json_object_get_array(root, "entries");
     const size_t count = json_array_get_count(entries);
+    warp_result_t result = warp_success();
     for (size_t i = 0; i < count; i++) {
-        warp_result_t result = warp_success();
         const JSON_Object *e = json_array_get_object(entries, i);
 
         chat_entry_t entry;
@@ -441,21 +327,29 @@ static warp_result_t parse(chat_t *chat, const JSON_Object *root) {
 
         const JSON_Array *responses = json_object_get_array(e, "responses");
         result = parse_responses(&entry, responses);
-        if (WARP_FAILED(result)) return result;
+        if (WARP_FAILED(result)) goto failed;
         
-        result = parse_entry_predicate(&entry, e);
-        if (WARP_FAILED(result)) return result;
+        result = parse_entry_predicate
+            (chat, e, i, &entry.predicate, &dependencies);
+        if (WARP_FAILED(result)) goto failed;
 
-        result = parse_entry_side_effect(&entry, e);
-        if (WARP_FAILED(result)) return result;
+        result = parse_entry_side_effect(chat, e, &entry.side_effect);
+        if (WARP_FAILED(result)) goto failed;
 
         warp_array_append(&chat->entries, &entry, 1);
     }
 
+    build_index(chat);
+    build_watches(chat, &dependencies);
+    warp_array_destroy(&dependencies);
     return warp_success();
+
+failed:
+    warp_array_destroy(&dependencies);
+    return result;
 }
 
-extern warp_result_t chat_parse(chat_t *chat, const char *path) {
+static warp_result_t parse_file(chat_t *chat, const char *path) {
     warp_array_t bytes = { NULL };
     warp_result_t read_result = read_file(path, &bytes);
     if (WARP_FAILED(read_result)) {
@@ -474,20 +368,47 @@ extern warp_result_t chat_parse(chat_t *chat, const char *path) {
     return result;
 }
 
+extern warp_result_t chat_parse(chat_t *chat, const char *path) {
+    TRACE_BEGIN("chat_parse");
+    warp_result_t result = parse_file(chat, path);
+    TRACE_END();
+    return result;
+}
+
+extern void chat_destroy(chat_t *chat) {
+    if (chat == NULL) return;
+    warp_array_destroy(&chat->entries);
+    warp_array_destroy(&chat->code);
+    warp_map_destroy(&chat->ids);
+    warp_str_destroy(&chat->default_portrait);
+    free(chat->index);
+    free(chat->watched);
+    free(chat->dependents);
+    memset(chat, 0, sizeof *chat);
+}
+
 struct chat_record {
     chat_t chat;
 };
 
+/* chat parsed elsewhere, taken by the next load instead of the file */
+static chat_t *adopted_chat = NULL;
+
 static warp_result_t load(void *ctx, const char *path, void *raw_record) {
     (void)ctx;
     struct chat_record *record = raw_record;
+    if (adopted_chat != NULL) {
+        record->chat = *adopted_chat;
+        adopted_chat = NULL;
+        return warp_success();
+    }
     return chat_parse(&record->chat, path);
 }
 
 static warp_result_t unload(void *ctx, void *raw_record) {
     (void)ctx;
     struct chat_record *record = raw_record;
-    warp_array_destroy(&record->chat.entries);
+    chat_destroy(&record->chat);
     return warp_success();
 }
 
@@ -509,6 +430,24 @@ extern void add_chat_loader(resources_t *res) {
     resources_add_loader(res, &loader);
 }
 
+extern void adopt_chat(warp_resources_t *res, const char *name, chat_t *chat) {
+    if (res == NULL || name == NULL || chat == NULL) {
+        warp_log_e("Adopt chat called with null resources, name or chat.");
+        return;
+    }
+    if (resources_lookup(res, name) == WARP_RES_ID_INVALID) {
+        adopted_chat = chat;
+        if (resources_load(res, name) == WARP_RES_ID_INVALID) {
+            warp_log_e("Failed to adopt chat resource: '%s'.", name);
+        }
+    }
+    /* not taken if already loaded or if loading failed before parsing */
+    if (adopted_chat != NULL) {
+        adopted_chat = NULL;
+        chat_destroy(chat);
+    }
+}
+
 extern const chat_t *get_chat(warp_resources_t *res, const char *name) {
     if (res == NULL) {
         warp_log_e("Get chat called with null resources.");
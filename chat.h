@@ -5,6 +5,9 @@
 #include "warp/utils/result.h"
 #include "warp/utils/random.h"
 #include "warp/collections/array.h"
+#include "warp/collections/map.h"
+
+#include "chat_script.h"
 
 #define MAX_CHAT_RESPONSES_COUNT 3
 
@@ -13,7 +16,6 @@ extern "C" {
 #endif
 
 typedef struct warp_resources warp_resources_t;
-typedef struct warp_map warp_map_t;
 
 typedef struct response {
     warp_str_t text;
@@ -24,28 +26,63 @@ typedef struct chat_entry {
     warp_tag_t id;
     bool can_start;
     warp_str_t text;
-    void *predicate;
-    void *side_effect;
+    uint32_t predicate;   /* index into chat code, CHAT_CODE_NONE if missing */
+    uint32_t side_effect;
     size_t responses_count;
     response_t responses[MAX_CHAT_RESPONSES_COUNT];
 } chat_entry_t;
 
+/* Part of the chat index: */
+typedef struct chat_range {
+    uint32_t first;
+    uint32_t count;
+} chat_range_t;
+
+/* Entries whose predicates read the fact: */
+typedef struct chat_watch {
+    fact_id_t fact;
+    chat_range_t dependents;
+} chat_watch_t;
+
 typedef struct chat {
     warp_array_t entries;
+    warp_array_t code; /* compiled predicates and side effects */
+    warp_map_t ids;    /* entry id to range of index */
+    uint32_t *index;   /* entry indices, start entries and then by id */
+    chat_range_t starts;
+    chat_watch_t *watched;  /* facts read by predicates, sorted by id */
+    size_t watched_count;
+    uint32_t *dependents;   /* entry indices, ranges of watches */
     warp_str_t default_portrait;
 } chat_t;
 
-const chat_entry_t *get_start_entry
-    (const chat_t *chat, warp_random_t *rand, const warp_map_t *facts);
+/* Predicate results of a chat for one set of facts, result is evaluated
+ * again only after a fact read by the predicate changes: */
+typedef struct chat_cache {
+    const chat_t *chat;
+    const fact_set_t *facts;
+    uint32_t synced_stamp;
+    uint8_t *results;
+} chat_cache_t;
+
+void chat_cache_init(chat_cache_t *cache, const chat_t *chat, const fact_set_t *facts);
+void chat_cache_destroy(chat_cache_t *cache);
+
+const chat_entry_t *get_start_entry(chat_cache_t *cache, warp_random_t *rand);
 const chat_entry_t *get_entry
-    (const chat_t *chat, warp_random_t *rand, const warp_map_t *facts, warp_tag_t id);
+    (chat_cache_t *cache, warp_random_t *rand, warp_tag_t id);
 
-void chat_entry_evaluate_side_effects(const chat_entry_t *entry, warp_map_t *facts);
+void chat_entry_evaluate_side_effects
+    (const chat_t *chat, const chat_entry_t *entry, fact_set_t *facts);
 
 warp_result_t chat_parse(chat_t *chat, const char *file_path);
+void chat_destroy(chat_t *chat);
 void add_chat_loader(warp_resources_t *res);
 /* Lookup or load chat if not already loaded: */
 const chat_t *get_chat(warp_resources_t *res, const char *name);
+/* Adds chat parsed elsewhere as resource of given name, takes ownership of
+ * the chat, it is destroyed if the name is already loaded: */
+void adopt_chat(warp_resources_t *res, const char *name, chat_t *chat);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,127 @@
+#define WARP_DROP_PREFIX
+#include "chat_preloader.h"
+
+#include <cstring>
+#include <algorithm>
+
+#include "warp/utils/io.h"
+#include "warp/utils/log.h"
+#include "warp/utils/str.h"
+
+using namespace warp;
+
+/* runs on the worker thread, uses no resources */
+static bool parse_chat(const char *name, chat_t *chat) {
+    memset(chat, 0, sizeof *chat);
+
+    warp_str_t path = warp_str_format("assets/data/%s", name);
+    warp_str_t out_path = { NULL };
+    bool success = false;
+
+    warp_result_t find_result = find_path(&path, &out_path);
+    warp_result_t parse_result;
+    if (WARP_FAILED(find_result)) {
+        warp_result_log("Failed to find chat path", &find_result);
+        warp_result_destory(&find_result);
+        goto cleanup;
+    }
+
+    parse_result = chat_parse(chat, warp_str_value(&out_path));
+    if (WARP_FAILED(parse_result)) {
+        warp_result_log("Failed to preload chat", &parse_result);
+        warp_result_destory(&parse_result);
+        chat_destroy(chat);
+        goto cleanup;
+    }
+    success = true;
+
+cleanup:
+    warp_str_destroy(&path);
+    warp_str_destroy(&out_path);
+    return success;
+}
+
+chat_preloader_t::chat_preloader_t()
+        : _running(true)
+        , _pending(0)
+        , _requested()
+        , _queue()
+        , _finished()
+        , _mutex()
+        , _wake()
+        , _done()
+        , _thread() {
+    _thread = std::thread(&chat_preloader_t::run, this);
+}
+
+chat_preloader_t::~chat_preloader_t() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _running = false;
+        _queue.clear();
+    }
+    _wake.notify_one();
+    _thread.join();
+
+    for (preloaded_chat_t &preloaded : _finished) {
+        if (preloaded.parsed) {
+            chat_destroy(&preloaded.chat);
+        }
+    }
+}
+
+void chat_preloader_t::request(const char *name) {
+    if (name == NULL || name[0] == '\0') return;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    const std::string requested(name);
+    const auto end = _requested.end();
+    if (std::find(_requested.begin(), end, requested) != end) return;
+
+    _requested.push_back(requested);
+    _queue.push_back(requested);
+    _pending += 1;
+    _wake.notify_one();
+}
+
+void chat_preloader_t::collect(warp_resources_t *res, bool wait) {
+    std::vector<preloaded_chat_t> finished;
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (wait) {
+            _done.wait(lock, [this]() { return _pending == 0; });
+        }
+        finished.swap(_finished);
+    }
+
+    for (preloaded_chat_t &preloaded : finished) {
+        /* failed chats are left to get_chat, which reports them again */
+        if (preloaded.parsed == false) continue;
+
+        const char *portrait = warp_str_value(&preloaded.chat.default_portrait);
+        if (resources_lookup(res, portrait) == WARP_RES_ID_INVALID) {
+            resources_load(res, portrait);
+        }
+        adopt_chat(res, preloaded.name.c_str(), &preloaded.chat);
+    }
+}
+
+void chat_preloader_t::run() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true) {
+        _wake.wait(lock, [this]() { return _running == false || _queue.empty() == false; });
+        if (_running == false) break;
+
+        preloaded_chat_t preloaded;
+        preloaded.name = _queue.front();
+        _queue.pop_front();
+
+        lock.unlock();
+        preloaded.parsed = parse_chat(preloaded.name.c_str(), &preloaded.chat);
+        lock.lock();
+
+        _finished.push_back(preloaded);
+        _pending -= 1;
+        _done.notify_all();
+    }
+}
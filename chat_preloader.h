@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "warp/resources/resources.h"
+
+#include "chat.h"
+
+/// Chat parsed off the main thread, not yet added to resources.
+struct preloaded_chat_t {
+    std::string name;
+    bool parsed;
+    chat_t chat;
+};
+
+/// Parses chats on a background thread, so starting a conversation does
+/// not read nor parse files.
+class chat_preloader_t {
+    public:
+        chat_preloader_t();
+        ~chat_preloader_t();
+
+        /// Queues chat for parsing, repeated requests are ignored.
+        void request(const char *name);
+        /// Adds chats finished since the last call to resources and loads
+        /// their portraits, must be called on the main thread. With wait
+        /// set it first waits for all requested chats.
+        void collect(warp_resources_t *res, bool wait);
+
+    private:
+        void run();
+
+    private:
+        bool _running;
+        size_t _pending;
+        std::vector<std::string> _requested;
+        std::deque<std::string> _queue;
+        std::vector<preloaded_chat_t> _finished;
+        std::mutex _mutex;
+        std::condition_variable _wake;
+        std::condition_variable _done;
+        std::thread _thread;
+};
@@ -0,0 +1,556 @@
+#define WARP_DROP_PREFIX
+#include "chat_script.h"
+
+#include <stdlib.h> /* strtol */
+#include <string.h>
+#include <ctype.h>
+
+#include <vector>
+#include <algorithm>
+#include <chrono>
+
+#include "warp/utils/log.h"
+#include "warp/utils/str.h"
+
+using namespace warp;
+
+enum chat_op_t : uint8_t {
+    OP_LOAD_INT = 0,
+    OP_LOAD_FACT,
+    OP_STORE_FACT,
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_MOD,
+    OP_EQ,
+    OP_NEQ,
+    OP_LT,
+    OP_LTE,
+    OP_GT,
+    OP_GTE,
+    OP_NOT,
+    OP_NEG,
+    OP_BOOL,
+    OP_JUMP_IF_FALSE,
+    OP_JUMP_IF_TRUE,
+    OP_RETURN,
+};
+
+static const size_t REGISTERS_COUNT = 16;
+
+/* compiler: */
+
+enum token_type_t {
+    TOKEN_END,
+    TOKEN_NUMBER,
+    TOKEN_NAME,
+    TOKEN_SYMBOL,
+    TOKEN_INVALID,
+};
+
+struct token_t {
+    token_type_t type;
+    const char *start;
+    size_t length;
+};
+
+struct compiler_t {
+    const char *source;
+    const char *cursor;
+    token_t token;
+    std::vector<chat_instruction_t> code;
+    std::vector<fact_id_t> reads;
+    fact_names_t *names;
+    bool failed;
+    warp_str_t error;
+};
+
+static bool is_name_start(char c) {
+    return isalpha((unsigned char)c) || c == '_';
+}
+
+static bool is_name_char(char c) {
+    return isalnum((unsigned char)c) || c == '_' || c == '.';
+}
+
+/* '<-' is not a symbol, it would make 'a<-1' mean 'a <- 1' in predicates */
+static const char *SYMBOLS[] = {
+    "==", "!=", "<=", ">=", "&&", "||", "+=", "-=",
+    "<", ">", "+", "-", "*", "/", "%", "!", "(", ")", ";",
+};
+
+static void next_token(compiler_t *c) {
+    while (isspace((unsigned char)*c->cursor)) {
+        c->cursor++;
+    }
+
+    token_t *token = &c->token;
+    const char *start = c->cursor;
+    token->start = start;
+    token->length = 0;
+
+    if (*start == '\0') {
+        token->type = TOKEN_END;
+        return;
+    }
+    if (isdigit((unsigned char)*start)) {
+        while (isdigit((unsigned char)*c->cursor)) c->cursor++;
+        token->type = TOKEN_NUMBER;
+        token->length = c->cursor - start;
+        return;
+    }
+    if (is_name_start(*start)) {
+        while (is_name_char(*c->cursor)) c->cursor++;
+        token->type = TOKEN_NAME;
+        token->length = c->cursor - start;
+        return;
+    }
+    for (const char *symbol : SYMBOLS) {
+        const size_t length = strlen(symbol);
+        if (strncmp(start, symbol, length) == 0) {
+            c->cursor += length;
+            token->type = TOKEN_SYMBOL;
+            token->length = length;
+            return;
+        }
+    }
+
+    token->type = TOKEN_INVALID;
+    token->length = 1;
+}
+
+static bool token_is(const compiler_t *c, token_type_t type, const char *text) {
+    const token_t *token = &c->token;
+    return token->type == type
+        && token->length == strlen(text)
+        && strncmp(token->start, text, token->length) == 0;
+}
+
+static bool is_symbol(const compiler_t *c, const char *symbol) {
+    return token_is(c, TOKEN_SYMBOL, symbol);
+}
+
+static void fail(compiler_t *c, const char *reason) {
+    if (c->failed) return;
+    c->failed = true;
+    c->error = warp_str_format
+        ( "%s at %d in '%s'", reason
+        , (int)(c->token.start - c->source), c->source
+        );
+}
+
+static size_t emit
+        (compiler_t *c, chat_op_t op, size_t target, size_t a, size_t b, int32_t value) {
+    chat_instruction_t instruction;
+    instruction.op = op;
+    instruction.target = target;
+    instruction.a = a;
+    instruction.b = b;
+    instruction.value = value;
+    c->code.push_back(instruction);
+    return c->code.size() - 1;
+}
+
+static void patch_jumps(compiler_t *c, const std::vector<size_t> &jumps) {
+    for (size_t jump : jumps) {
+        c->code[jump].value = c->code.size();
+    }
+}
+
+static bool check_register(compiler_t *c, size_t r) {
+    if (r >= REGISTERS_COUNT) {
+        fail(c, "Expression is nested too deep");
+        return false;
+    }
+    return true;
+}
+
+static fact_id_t intern_token(const compiler_t *c) {
+    warp_str_t name = warp_str_format("%.*s", (int)c->token.length, c->token.start);
+    const fact_id_t fact = fact_names_intern(c->names, warp_str_value(&name));
+    warp_str_destroy(&name);
+    return fact;
+}
+
+/* each rule leaves its value in register r and may use registers above */
+static void compile_or(compiler_t *c, size_t r);
+
+static void compile_primary(compiler_t *c, size_t r) {
+    if (check_register(c, r) == false) return;
+
+    if (c->token.type == TOKEN_NUMBER) {
+        const long value = strtol(c->token.start, NULL, 10);
+        emit(c, OP_LOAD_INT, r, 0, 0, (int32_t)value);
+        next_token(c);
+    } else if (token_is(c, TOKEN_NAME, "true")) {
+        emit(c, OP_LOAD_INT, r, 0, 0, 1);
+        next_token(c);
+    } else if (token_is(c, TOKEN_NAME, "false")) {
+        emit(c, OP_LOAD_INT, r, 0, 0, 0);
+        next_token(c);
+    } else if (c->token.type == TOKEN_NAME) {
+        const fact_id_t fact = intern_token(c);
+        emit(c, OP_LOAD_FACT, r, 0, 0, (int32_t)fact);
+        if (std::find(c->reads.begin(), c->reads.end(), fact) == c->reads.end()) {
+            c->reads.push_back(fact);
+        }
+        next_token(c);
+    } else if (is_symbol(c, "(")) {
+        next_token(c);
+        compile_or(c, r);
+        if (is_symbol(c, ")") == false) {
+            fail(c, "Expected ')'");
+            return;
+        }
+        next_token(c);
+    } else {
+        fail(c, "Expected value");
+    }
+}
+
+static void compile_unary(compiler_t *c, size_t r) {
+    if (is_symbol(c, "!")) {
+        next_token(c);
+        compile_unary(c, r);
+        emit(c, OP_NOT, r, r, 0, 0);
+    } else if (is_symbol(c, "-")) {
+        next_token(c);
+        compile_unary(c, r);
+        emit(c, OP_NEG, r, r, 0, 0);
+    } else {
+        compile_primary(c, r);
+    }
+}
+
+struct binary_op_t {
+    const char *symbol;
+    chat_op_t op;
+};
+
+static const binary_op_t PRODUCT_OPS[] =
+    { { "*", OP_MUL }, { "/", OP_DIV }, { "%", OP_MOD } };
+static const binary_op_t SUM_OPS[] =
+    { { "+", OP_ADD }, { "-", OP_SUB } };
+static const binary_op_t COMPARISON_OPS[] =
+    { { "==", OP_EQ }, { "!=", OP_NEQ }, { "<", OP_LT }
+    , { "<=", OP_LTE }, { ">", OP_GT }, { ">=", OP_GTE }
+    };
+
+template <size_t N>
+static const binary_op_t *match_op(const compiler_t *c, const binary_op_t (&ops)[N]) {
+    for (size_t i = 0; i < N; i++) {
+        if (is_symbol(c, ops[i].symbol)) return ops + i;
+    }
+    return NULL;
+}
+
+static void compile_product(compiler_t *c, size_t r) {
+    compile_unary(c, r);
+    const binary_op_t *op = NULL;
+    while (c->failed == false && (op = match_op(c, PRODUCT_OPS)) != NULL) {
+        next_token(c);
+        compile_unary(c, r + 1);
+        emit(c, op->op, r, r, r + 1, 0);
+    }
+}
+
+static void compile_sum(compiler_t *c, size_t r) {
+    compile_product(c, r);
+    const binary_op_t *op = NULL;
+    while (c->failed == false && (op = match_op(c, SUM_OPS)) != NULL) {
+        next_token(c);
+        compile_product(c, r + 1);
+        emit(c, op->op, r, r, r + 1, 0);
+    }
+}
+
+static void compile_comparison(compiler_t *c, size_t r) {
+    compile_sum(c, r);
+    const binary_op_t *op = match_op(c, COMPARISON_OPS);
+    if (c->failed == false && op != NULL) {
+        next_token(c);
+        compile_sum(c, r + 1);
+        emit(c, op->op, r, r, r + 1, 0);
+    }
+}
+
+/* && and || skip their right side when left one decides the result */
+static void compile_and(compiler_t *c, size_t r) {
+    compile_comparison(c, r);
+    std::vector<size_t> jumps;
+    while (c->failed == false && is_symbol(c, "&&")) {
+        next_token(c);
+        jumps.push_back(emit(c, OP_JUMP_IF_FALSE, 0, r, 0, 0));
+        compile_comparison(c, r);
+    }
+    if (jumps.empty() == false) {
+        patch_jumps(c, jumps);
+        emit(c, OP_BOOL, r, r, 0, 0);
+    }
+}
+
+static void compile_or(compiler_t *c, size_t r) {
+    compile_and(c, r);
+    std::vector<size_t> jumps;
+    while (c->failed == false && is_symbol(c, "||")) {
+        next_token(c);
+        jumps.push_back(emit(c, OP_JUMP_IF_TRUE, 0, r, 0, 0));
+        compile_and(c, r);
+    }
+    if (jumps.empty() == false) {
+        patch_jumps(c, jumps);
+        emit(c, OP_BOOL, r, r, 0, 0);
+    }
+}
+
+static void compile_statement(compiler_t *c) {
+    if (c->token.type != TOKEN_NAME
+            || token_is(c, TOKEN_NAME, "true")
+            || token_is(c, TOKEN_NAME, "false")) {
+        fail(c, "Expected fact name");
+        return;
+    }
+    const fact_id_t fact = intern_token(c);
+    next_token(c);
+
+    chat_op_t op = OP_LOAD_INT;
+    if (is_symbol(c, "<") && *c->cursor == '-') {
+        c->cursor++;
+    } else if (is_symbol(c, "+=")) {
+        op = OP_ADD;
+    } else if (is_symbol(c, "-=")) {
+        op = OP_SUB;
+    } else {
+        fail(c, "Expected '<-', '+=' or '-='");
+        return;
+    }
+    next_token(c);
+
+    compile_or(c, 0);
+    if (op != OP_LOAD_INT) {
+        emit(c, OP_LOAD_FACT, 1, 0, 0, (int32_t)fact);
+        emit(c, op, 0, 1, 0, 0);
+    }
+    emit(c, OP_STORE_FACT, 0, 0, 0, (int32_t)fact);
+}
+
+static void init_compiler(compiler_t *c, const char *source, fact_names_t *names) {
+    c->source = source;
+    c->cursor = source;
+    c->names = names;
+    c->failed = false;
+    c->error = { NULL };
+    next_token(c);
+}
+
+static warp_result_t finish_compiler
+        (compiler_t *c, warp_array_t *code, uint32_t *start) {
+    if (c->failed == false && c->token.type != TOKEN_END) {
+        fail(c, "Unexpected token");
+    }
+    if (c->failed) {
+        warp_result_t result
+            = warp_failure("Failed to compile chat script: %s.", warp_str_value(&c->error));
+        warp_str_destroy(&c->error);
+        return result;
+    }
+
+    /* jump targets are relative to the start of the program */
+    *start = warp_array_get_size(code);
+    warp_array_append(code, c->code.data(), c->code.size());
+    return warp_success();
+}
+
+extern warp_result_t chat_compile_predicate
+        ( warp_array_t *code, const char *source, uint32_t *start
+        , warp_array_t *dependencies, fact_names_t *names
+        ) {
+    compiler_t c;
+    init_compiler(&c, source, names);
+    compile_or(&c, 0);
+    emit(&c, OP_RETURN, 0, 0, 0, 0);
+
+    warp_result_t result = finish_compiler(&c, code, start);
+    if (WARP_FAILED(result) == false && dependencies != NULL) {
+        warp_array_append(dependencies, c.reads.data(), c.reads.size());
+    }
+    return result;
+}
+
+extern warp_result_t chat_compile_side_effects
+        ( warp_array_t *code, const char *source, uint32_t *start
+        , fact_names_t *names
+        ) {
+    compiler_t c;
+    init_compiler(&c, source, names);
+    while (c.failed == false && c.token.type != TOKEN_END) {
+        compile_statement(&c);
+        if (c.failed || is_symbol(&c, ";") == false) break;
+        next_token(&c);
+    }
+    emit(&c, OP_RETURN, 0, 0, 0, 0);
+    return finish_compiler(&c, code, start);
+}
+
+/* virtual machine: */
+
+static inline int get_fact_value(const fact_set_t *facts, int32_t id) {
+    return (uint32_t)id < facts->count ? facts->values[id] : 0;
+}
+
+/* output is null for predicates, they never store facts */
+static int run
+        ( const chat_instruction_t *code
+        , const fact_set_t *facts, fact_set_t *output
+        ) {
+    int r[REGISTERS_COUNT];
+    const chat_instruction_t *i = code;
+    while (true) {
+        switch ((chat_op_t)i->op) {
+            case OP_LOAD_INT:  r[i->target] = i->value; break;
+            case OP_LOAD_FACT: r[i->target] = get_fact_value(facts, i->value); break;
+            case OP_STORE_FACT:
+                fact_set_set(output, (fact_id_t)i->value, r[i->a]);
+                break;
+            case OP_ADD: r[i->target] = r[i->a] + r[i->b]; break;
+            case OP_SUB: r[i->target] = r[i->a] - r[i->b]; break;
+            case OP_MUL: r[i->target] = r[i->a] * r[i->b]; break;
+            case OP_DIV: r[i->target] = r[i->b] == 0 ? 0 : r[i->a] / r[i->b]; break;
+            case OP_MOD: r[i->target] = r[i->b] == 0 ? 0 : r[i->a] % r[i->b]; break;
+            case OP_EQ:  r[i->target] = r[i->a] == r[i->b]; break;
+            case OP_NEQ: r[i->target] = r[i->a] != r[i->b]; break;
+            case OP_LT:  r[i->target] = r[i->a] <  r[i->b]; break;
+            case OP_LTE: r[i->target] = r[i->a] <= r[i->b]; break;
+            case OP_GT:  r[i->target] = r[i->a] >  r[i->b]; break;
+            case OP_GTE: r[i->target] = r[i->a] >= r[i->b]; break;
+            case OP_NOT:  r[i->target] = r[i->a] == 0; break;
+            case OP_NEG:  r[i->target] = -r[i->a]; break;
+            case OP_BOOL: r[i->target] = r[i->a] != 0; break;
+            case OP_JUMP_IF_FALSE:
+                if (r[i->a] == 0) {
+                    i = code + i->value;
+                    continue;
+                }
+                break;
+            case OP_JUMP_IF_TRUE:
+                if (r[i->a] != 0) {
+                    i = code + i->value;
+                    continue;
+                }
+                break;
+            case OP_RETURN: return r[i->a];
+        }
+        i++;
+    }
+}
+
+extern bool chat_run_predicate
+        (const chat_instruction_t *code, const fact_set_t *facts) {
+    if (code == NULL) return true;
+    return run(code, facts, NULL) != 0;
+}
+
+extern void chat_run_side_effects
+        (const chat_instruction_t *code, fact_set_t *facts) {
+    if (code == NULL) return;
+    run(code, facts, facts);
+}
+
+/* benchmark: */
+
+static double elapsed_ms(std::chrono::steady_clock::time_point start) {
+    const auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+static const char *BENCHMARK_PREDICATES[] = {
+    "bench.a%zu == 1",
+    "bench.a%zu >= 2 && bench.b%zu < 5",
+    "(bench.a%zu + bench.b%zu) * 2 > 7 || !bench.c%zu",
+    "bench.a%zu %% 3 == 1 && (bench.b%zu != 0 || bench.c%zu - 1 <= -2)",
+};
+
+static const char *BENCHMARK_SIDE_EFFECTS[] = {
+    "bench.a%zu <- 1",
+    "bench.a%zu += 1; bench.b%zu -= bench.a%zu",
+};
+
+extern void benchmark_chat_scripts(size_t entries_count) {
+    /* few distinct facts, scripts usually share them; their names stay out
+     * of the table shared with the game */
+    const size_t facts_count = 64;
+    fact_names_t *names = fact_names_create();
+    const size_t predicates_count = sizeof BENCHMARK_PREDICATES / sizeof *BENCHMARK_PREDICATES;
+    const size_t effects_count = sizeof BENCHMARK_SIDE_EFFECTS / sizeof *BENCHMARK_SIDE_EFFECTS;
+
+    warp_array_t code = warp_array_create_typed(chat_instruction_t, 1024, NULL);
+    std::vector<uint32_t> predicates(entries_count);
+    std::vector<uint32_t> effects(entries_count);
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < entries_count; i++) {
+        const size_t f = i % facts_count;
+        const char *predicate_format = BENCHMARK_PREDICATES[i % predicates_count];
+        const char *effect_format = BENCHMARK_SIDE_EFFECTS[i % effects_count];
+        warp_str_t predicate = warp_str_format(predicate_format, f, f, f);
+        warp_str_t effect = warp_str_format(effect_format, f, f, f);
+
+        warp_result_t result
+            = chat_compile_predicate
+                (&code, warp_str_value(&predicate), &predicates[i], NULL, names);
+        if (WARP_FAILED(result)) {
+            warp_result_log("Failed to compile benchmark predicate", &result);
+        }
+        warp_result_destory(&result);
+        result = chat_compile_side_effects
+            (&code, warp_str_value(&effect), &effects[i], names);
+        if (WARP_FAILED(result)) {
+            warp_result_log("Failed to compile benchmark side effect", &result);
+        }
+        warp_result_destory(&result);
+
+        warp_str_destroy(&predicate);
+        warp_str_destroy(&effect);
+    }
+    const double compile_time = elapsed_ms(start);
+
+    fact_set_t facts;
+    fact_set_init(&facts);
+    fact_set_set(&facts, fact_names_intern(names, "bench.a0"), 1);
+
+    const chat_instruction_t *instructions
+        = (const chat_instruction_t *) warp_array_get(&code, 0);
+    const size_t iterations = 100;
+
+    size_t passed = 0;
+    start = std::chrono::steady_clock::now();
+    for (size_t n = 0; n < iterations; n++) {
+        for (size_t i = 0; i < entries_count; i++) {
+            passed += chat_run_predicate(instructions + predicates[i], &facts);
+        }
+    }
+    const double predicates_time = elapsed_ms(start);
+
+    start = std::chrono::steady_clock::now();
+    for (size_t n = 0; n < iterations; n++) {
+        for (size_t i = 0; i < entries_count; i++) {
+            chat_run_side_effects(instructions + effects[i], &facts);
+        }
+    }
+    const double effects_time = elapsed_ms(start);
+
+    const double evaluations = (double)iterations * entries_count;
+    warp_log_d( "Chat scripts of %zu entries: %zu instructions (%zu bytes)"
+                " compiled in %.3f ms, predicates %.1f ns per entry"
+                " (%zu passed), side effects %.1f ns per entry."
+              , entries_count, warp_array_get_size(&code)
+              , warp_array_get_size(&code) * sizeof (chat_instruction_t)
+              , compile_time, predicates_time * 1e6 / evaluations, passed
+              , effects_time * 1e6 / evaluations
+              );
+
+    fact_set_destroy(&facts);
+    warp_array_destroy(&code);
+    fact_names_destroy(names);
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "warp/utils/result.h"
+#include "warp/collections/array.h"
+
+#include "facts.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Chat predicates and side effects are compiled to register code when chat
+ * is loaded, code of all entries of a chat is kept in one array.
+ *
+ * Predicates are expressions with ||, &&, comparisons, + - * / %, unary
+ * ! and -, parentheses, integers, true, false and fact names. Side effects
+ * are statements separated by ';', each one of: fact <- expr,
+ * fact += expr, fact -= expr. */
+
+typedef struct chat_instruction {
+    uint8_t op;
+    uint8_t target;
+    uint8_t a;
+    uint8_t b;
+    int32_t value; /* literal, fact id or jump target */
+} chat_instruction_t;
+
+#define CHAT_CODE_NONE ((uint32_t)-1)
+
+/* Appends compiled code to array of chat_instruction_t, start is set to
+ * index of its first instruction. Fact names are interned in names, chats
+ * of the game use the shared table. Predicate also appends ids of facts it
+ * reads to dependencies, each one once: */
+warp_result_t chat_compile_predicate
+    ( warp_array_t *code, const char *source, uint32_t *start
+    , warp_array_t *dependencies, fact_names_t *names
+    );
+warp_result_t chat_compile_side_effects
+    ( warp_array_t *code, const char *source, uint32_t *start
+    , fact_names_t *names
+    );
+
+/* Running code never allocates: */
+bool chat_run_predicate(const chat_instruction_t *code, const fact_set_t *facts);
+void chat_run_side_effects(const chat_instruction_t *code, fact_set_t *facts);
+
+void benchmark_chat_scripts(size_t entries_count);
+
+#ifdef __cplusplus
+}
+#endif
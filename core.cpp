@@ -30,13 +30,26 @@
 #include "bullets.h"
 #include "button.h"
 #include "persitence.h"
+#include "facts.h"
 #include "text-label.h"
 #include "transition_effect.h"
 #include "version.h"
+#include "message_bus.h"
+#include "tweens.h"
+#include "entities.h"
+#include "perf.h"
+#include "trace.h"
 
 using namespace warp;
 
 static const float LEVEL_TRANSITION_TIME = 1.0f;
+static const size_t REGION_LEVELS_BUDGET = 4 * 1024 * 1024; /* bytes */
+static const size_t DIAG_BUFFER_SIZE = 2048;
+
+static const core_msgs_t CORE_SUBSCRIPTIONS[] = {
+    CORE_TRY_MOVE, CORE_TRY_SHOOT, CORE_AI_COMMAND,
+    CORE_RESTART_LEVEL, CORE_SAVE_RESET_DEFAULTS,
+};
 
 enum core_state_t {
     CSTATE_IDLE = 0,
@@ -45,13 +58,17 @@ enum core_state_t {
     CSTATE_CONVERSATION,
 };
 
+/* Widgets are created on first use and then kept for the whole state,
+ * dialog steps only change their texts and visibility: */
 struct converation_state_t {
     entity_t *fader;
     entity_t *text;
-    entity_t *portrait;
-    entity_t *buttons[3];
-    size_t buttons_count;
+    entity_t *portrait;  /* one of portraits, shown during conversation */
+    warp_map_t portraits;
+    entity_t *buttons[MAX_CHAT_RESPONSES_COUNT];
+    warp_tag_t next_ids[MAX_CHAT_RESPONSES_COUNT];
     const chat_t *chat;
+    chat_cache_t cache;
 };
 
 static void destroy_string(void *raw_str) {
@@ -73,6 +90,7 @@ class core_controller_t final : public controller_impl_i {
         core_controller_t(const portal_t *start)
                 : _owner(NULL)
                 , _world(NULL)
+                , _tweens(NULL)
                 , _portal(*start)
                 , _waiting_for_animation(false)
                 , _region(NULL)
@@ -81,26 +99,36 @@ class core_controller_t final : public controller_impl_i {
                 , _previous_level_x(0), _previous_level_z(0)
                 , _level_state(NULL)
                 , _font(WARP_RES_ID_INVALID)
+                , _bubbles(NULL)
                 , _state(CSTATE_IDLE)
                 , _transition_timer(0) 
                 , _pain_texts()
                 , _random(NULL) 
                 , _diagnostics(false)
                 , _diag_label(NULL)
-                , _diag_buffer(NULL) {
+                , _diag_buffer(NULL)
+                , _health_label(NULL)
+                , _ammo_label(NULL) {
             _portal.region_name = warp_str_copy(&start->region_name);
             _pain_texts = create_pain_texts();
-            _facts = warp_map_create_typed(int, NULL);
+            fact_set_init(&_facts);
             memset(&_conversation, 0, sizeof _conversation);
+            _conversation.portraits = warp_map_create_typed(entity_t *, NULL);
         }
 
         ~core_controller_t() {
+            if (_bus != nullptr) {
+                _bus->unsubscribe_all(_owner);
+            }
             delete _level_state;
             delete _region;
+            delete _bubbles;
 
             warp_str_destroy(&_portal.region_name);
             warp_array_destroy(&_pain_texts);
-            warp_map_destroy(&_facts);
+            chat_cache_destroy(&_conversation.cache);
+            warp_map_destroy(&_conversation.portraits);
+            fact_set_destroy(&_facts);
             warp_random_destroy(_random);
         }
 
@@ -115,17 +143,35 @@ class core_controller_t final : public controller_impl_i {
             _owner = owner;
             _world = world;
 
+            _bus = get_message_bus(_world)->shared_from_this();
+            _tweens = get_tweens(_world);
+            for (core_msgs_t type : CORE_SUBSCRIPTIONS) {
+                _bus->subscribe(type, _owner);
+            }
+
             _level_x = _portal.level_x;
             _level_z = _portal.level_z;
 
+            /* hud labels are created with the state, before core */
+            _health_label = _world->find_entity(WARP_TAG("health_label"));
+            _ammo_label = _world->find_entity(WARP_TAG("ammo_label"));
+            /* overlay stays on across regions, so region load is measured */
+            if (perf_overlay_enabled) {
+                enable_diagnostics(true);
+            }
+
             const uint32_t seed = get_saved_seed(_world);
             _random = warp_random_create(seed);
 
-            const warp_map_t *facts = get_saved_facts(_world);
-            warp_map_copy_entries(&_facts, facts);
+            const fact_set_t *facts = get_saved_facts(_world);
+            fact_set_copy(&_facts, facts);
 
             const char *region_name = warp_str_value(&_portal.region_name); 
-            _region = load_region(region_name);
+            {
+                perf_scope_t perf_scope(PERF_REGION_LOAD_TIME);
+                TRACE_SCOPE("load_region");
+                _region = load_region(region_name, REGION_LEVELS_BUDGET);
+            }
             if (_region == NULL) {
                 warp_critical("Failed to load region: '%s'", region_name);
             }
@@ -139,6 +185,7 @@ class core_controller_t final : public controller_impl_i {
             }
             
             _font = get_default_font(_world->get_resources());
+            _bubbles = new speech_bubble_pool_t(_world, _font);
             const size_t width  = _level->get_width();
             const size_t height = _level->get_height();
             _level_state = new level_state_t(_world, width, height);
@@ -185,7 +232,12 @@ class core_controller_t final : public controller_impl_i {
         }
 
         void update(float dt, const input_t &) override {
+            TRACE_SCOPE("core_controller_t::update");
+            const size_t tessellated = take_label_tessellations_count();
+            PERF_ADD(PERF_TESSELLATIONS, tessellated);
+            perf_end_frame(dt);
             update_diagnostics();
+            _level_state->collect_resources(false);
 
             if (_state == CSTATE_LEVEL_TRANSITION) {
                 _transition_timer -= dt;
@@ -218,11 +270,21 @@ class core_controller_t final : public controller_impl_i {
         }
 
         void handle_message(const message_t &message) override {
+            TRACE_SCOPE("core_controller_t::handle_message");
             const messagetype_t type = message.type;
             if (type == MSG_INPUT_KEY_UP) {
                 SDL_Keycode code = message.data.get_int();
                 if (code == SDLK_g) {
                     enable_diagnostics(_diagnostics == false);
+                } else if (code == SDLK_b && _diagnostics) {
+                    /* preloader parses chats, it must be idle */
+                    _level_state->collect_resources(true);
+                    const char *name = warp_str_value(&_portal.region_name);
+                    benchmark_region(_world->get_resources(), name);
+                    benchmark_save_format(10000);
+                    benchmark_chat_scripts(10000);
+                } else if (code == SDLK_t && _diagnostics) {
+                    trace_export("trace.json");
                 }
             }
             if (_state != CSTATE_IDLE) { 
@@ -234,18 +296,6 @@ class core_controller_t final : public controller_impl_i {
                 change_region(&_portal, true);
             } else if (type == CORE_SAVE_RESET_DEFAULTS) {
                 change_region(&_portal, false);
-            } else if (type == CORE_BULLET_HIT) {
-                warp_log_d("real time event");
-                rt_event_t event = {RT_EVENT_BULETT_HIT, message.data};
-                _level_state->process_real_time_event(event);
-
-                check_events();
-            } else if (type == CORE_MOVE_DONE && _waiting_for_animation) {
-                warp_log_d("NPC turn");
-                _waiting_for_animation = false;
-                next_turn();
-
-                check_events();
             } else if (_level_state->is_object_idle(player) &&
                         (type == CORE_TRY_MOVE || type == CORE_TRY_SHOOT)) {
                 warp_log_d("player turn");
@@ -255,7 +305,7 @@ class core_controller_t final : public controller_impl_i {
                 _level_state->apply_command(&cmd);
 
                 check_events();
-                _waiting_for_animation = true;
+                wait_for_animation(player);
             } else if (type == CORE_AI_COMMAND) {
                 const command_t *cmd = (command_t *) message.data.get_pointer();
                 _level_state->apply_command(cmd);
@@ -266,6 +316,9 @@ class core_controller_t final : public controller_impl_i {
     private:
         entity_t *_owner;
         world_t *_world;
+        /* shared, the bus is kept between states but not past the world */
+        std::shared_ptr<message_bus_t> _bus;
+        tween_system_t *_tweens;
 
         portal_t _portal;
         object_t _last_player_state;
@@ -281,6 +334,7 @@ class core_controller_t final : public controller_impl_i {
         level_state_t *_level_state;
 
         res_id_t _font;
+        speech_bubble_pool_t *_bubbles;
 
         core_state_t _state;
         float _transition_timer;
@@ -288,19 +342,23 @@ class core_controller_t final : public controller_impl_i {
         converation_state_t _conversation;
 
         warp_array_t _pain_texts;
-        warp_map_t _facts;
+        fact_set_t _facts;
         warp_random_t *_random;
 
         bool _diagnostics;
         entity_t *_diag_label;
         char *_diag_buffer;
 
+        entity_t *_health_label;
+        entity_t *_ammo_label;
+
         void enable_diagnostics(bool enable) {
             _diagnostics = enable;
+            perf_enable(enable);
             _diag_label = _world->find_entity(WARP_TAG("diag_label"));
             _diag_label->receive_message(MSG_GRAPHICS_VISIBLITY, (int)enable);
             if (_diag_buffer == NULL) {
-                _diag_buffer = new char [1024];
+                _diag_buffer = new char [DIAG_BUFFER_SIZE];
             }
         }
 
@@ -319,18 +377,21 @@ class core_controller_t final : public controller_impl_i {
             const stats_t &stats = _world->get_statistics();
 
             snprintf
-                ( _diag_buffer, 1024
-                , "%s\n%s\nlevel x: %zu z: %zu, tile x: %zu z: %zu\n%f fps"
+                ( _diag_buffer, DIAG_BUFFER_SIZE
+                , "%s\n%s\nlevel x: %zu z: %zu, tile x: %zu z: %zu\n%.1f fps\n"
                 , VERSION
                 , warp_str_value(&_portal.region_name)
                 , _level_x, _level_z, x, z
                 , stats.avg_fps
                 );
+            const size_t length = strlen(_diag_buffer);
+            perf_format(_diag_buffer + length, DIAG_BUFFER_SIZE - length);
 
             _diag_label->receive_message(CORE_SHOW_POINTER_TEXT, (void *)_diag_buffer);
         }
 
         void check_events() {
+            TRACE_SCOPE("check_events");
             for (const event_t &event : _level_state->get_last_turn_events()) {
                 const event_type_t type = event.type;
                 const object_t *obj = &event.object_state;
@@ -405,7 +466,7 @@ class core_controller_t final : public controller_impl_i {
                 return;
             }
             const vec3_t pos = vec3_add(obj->position, vec3(0, 1.3f, -0.1f));
-            create_speech_bubble(_world, _font, pos, text);
+            _bubbles->emit(pos, text);
         }
 
         void update_player_health_display(const object_t *player) {
@@ -413,18 +474,19 @@ class core_controller_t final : public controller_impl_i {
                 warp_log_e("Cannot update health, player is null.");
                 return;
             }
-            const int max_hp = player->max_health;
+            if (_health_label == NULL) return;
 
-            entity_t *hp_label = _world->find_entity(WARP_TAG("health_label"));
-            if (hp_label != NULL) {
-                char *buffer = (char *)calloc(max_hp + 1, sizeof (char));
-                for (size_t i = 0; i < (size_t)max_hp; i++) {
-                    buffer[i] = (int)i < player->health ? '#' : '$';
-                }
-                buffer[max_hp] = '\0';
-                hp_label->receive_message(CORE_SHOW_TAG_TEXT, WARP_TAG(buffer));
-                free(buffer);
+            char buffer[64];
+            size_t max_hp = player->max_health < 0 ? 0 : player->max_health;
+            if (max_hp > sizeof buffer - 1) {
+                max_hp = sizeof buffer - 1;
             }
+            for (size_t i = 0; i < max_hp; i++) {
+                buffer[i] = (int)i < player->health ? '#' : '$';
+            }
+            buffer[max_hp] = '\0';
+            /* label skips the update if the text did not change */
+            _health_label->receive_message(CORE_SHOW_POINTER_TEXT, (void *)buffer);
         }
 
         void update_player_ammo_display(const object_t *player) {
@@ -433,30 +495,32 @@ class core_controller_t final : public controller_impl_i {
                 return;
             }
 
-            entity_t *ammo_label = _world->find_entity(WARP_TAG("ammo_label"));
-            if (ammo_label != NULL) {
-                if (player->flags & FOBJ_CAN_SHOOT) {
-                    char buffer[16];
-                    snprintf(buffer, 16, "*%2d", player->ammo);
-                    ammo_label->receive_message(CORE_SHOW_TAG_TEXT, WARP_TAG(buffer));
-                    ammo_label->receive_message(MSG_GRAPHICS_VISIBLITY, 1);
-                } else {
-                    ammo_label->receive_message(MSG_GRAPHICS_VISIBLITY, 0);
-                }
+            if (_ammo_label == NULL) return;
+
+            if (player->flags & FOBJ_CAN_SHOOT) {
+                char buffer[16];
+                snprintf(buffer, 16, "*%2d", player->ammo);
+                _ammo_label->receive_message(CORE_SHOW_POINTER_TEXT, (void *)buffer);
+                _ammo_label->receive_message(MSG_GRAPHICS_VISIBLITY, 1);
+            } else {
+                _ammo_label->receive_message(MSG_GRAPHICS_VISIBLITY, 0);
             }
         }
 
         void end_conversation() {
             _state = CSTATE_IDLE;
-            for (size_t i = 0; i < _conversation.buttons_count; i++) {
-                _world->destroy_later(_conversation.buttons[i]);
+            for (size_t i = 0; i < MAX_CHAT_RESPONSES_COUNT; i++) {
+                hide_widget(_conversation.buttons[i]);
             }
-            _world->destroy_later(_conversation.fader);
-            _world->destroy_later(_conversation.text);
-            _world->destroy_later(_conversation.portrait);
-
-            _conversation.fader = create_fade_circle(_world, 700, 1.0f, false);
-            _conversation.fader->receive_message(MSG_GRAPHICS_RECOLOR, vec4(0, 0, 0, 0.7f));
+            hide_widget(_conversation.text);
+            hide_widget(_conversation.portrait);
+            destroy_game_entity(_world, _conversation.fader);
+            _conversation.fader = NULL;
+            chat_cache_destroy(&_conversation.cache);
+
+            /* fading out destroys itself, so it is not kept */
+            entity_t *fader = create_fade_circle(_world, 700, 1.0f, false);
+            fader->receive_message(MSG_GRAPHICS_RECOLOR, vec4(0, 0, 0, 0.7f));
         }
 
         void update_conversation(warp_tag_t next_id) {
@@ -465,58 +529,97 @@ class core_controller_t final : public controller_impl_i {
                 return;
             }
             const chat_entry_t *entry
-                = get_entry(_conversation.chat, _random, &_facts, next_id);
-            const char *message = warp_str_value(&entry->text);
-            _conversation.text->receive_message(CORE_SHOW_POINTER_TEXT, (void *)message);
-            
-            chat_entry_evaluate_side_effects(entry, &_facts);
-
-            for (size_t i = 0; i < _conversation.buttons_count; i++) {
-                _world->destroy_later(_conversation.buttons[i]);
+                = get_entry(&_conversation.cache, _random, next_id);
+            if (entry == NULL) {
+                end_conversation();
+                return;
             }
-            create_conversation_buttons(entry);
+            show_conversation_entry(entry);
         }
 
         void start_conversation(const object_t *npc) {
-            (void) npc;
+            /* usually a no-op, chats are preloaded with the level */
+            _level_state->collect_resources(true);
+            const chat_t *chat = get_chat(_world->get_resources(), npc->chat_scipt);
+            if (chat == NULL) return;
+
+            chat_cache_init(&_conversation.cache, chat, &_facts);
+            const chat_entry_t *start = get_start_entry(&_conversation.cache, _random);
+            if (start == NULL) {
+                chat_cache_destroy(&_conversation.cache);
+                return;
+            }
+
             _state = CSTATE_CONVERSATION;
             if (_conversation.fader != NULL) {
-                _world->destroy_later(_conversation.fader);
+                destroy_game_entity(_world, _conversation.fader);
             }
 
             _conversation.fader = create_fade_circle(_world, 700, 1.0f, true);
             _conversation.fader->receive_message(MSG_GRAPHICS_RECOLOR, vec4(0, 0, 0, 0.7f));
 
-            _conversation.chat = get_chat(_world->get_resources(), npc->chat_scipt);
-            const chat_entry_t *start = get_start_entry(_conversation.chat, _random, &_facts);
+            _conversation.chat = chat;
+            show_portrait(warp_str_value(&chat->default_portrait));
+            show_conversation_entry(start);
+        }
 
-            const res_id_t font = get_dialog_font(_world->get_resources());
-            const char *message = warp_str_value(&start->text);
-            _conversation.text
-                = create_label(_world, font, LABEL_POS_LEFT | LABEL_POS_BOTTOM);
-            _conversation.text->receive_message(MSG_PHYSICS_MOVE, vec3(-130 + 16, -64, 8));
-            _conversation.text->receive_message(CORE_SHOW_POINTER_TEXT, (void *)message);
-            _conversation.text->receive_message(MSG_PHYSICS_SCALE, vec3(1.6f, 1.6f, 1));
+        static void hide_widget(entity_t *widget) {
+            if (widget != NULL) {
+                widget->receive_message(MSG_GRAPHICS_VISIBLITY, 0);
+            }
+        }
 
-            const char *portrait_tex = warp_str_value(&_conversation.chat->default_portrait);
-            _conversation.portrait =
-                create_ui_image(_world, vec2(-300, -128), vec2(256, 512), portrait_tex);
+        void show_portrait(const char *texture) {
+            hide_widget(_conversation.portrait);
+
+            entity_t **found = (entity_t **)warp_map_get(&_conversation.portraits, texture);
+            if (found != NULL) {
+                _conversation.portrait = *found;
+                _conversation.portrait->receive_message(MSG_GRAPHICS_VISIBLITY, 1);
+            } else {
+                _conversation.portrait =
+                    create_ui_image(_world, vec2(-300, -128), vec2(256, 512), texture);
+                warp_map_insert(&_conversation.portraits, texture, &_conversation.portrait);
+            }
+        }
+
+        void show_conversation_entry(const chat_entry_t *entry) {
+            const char *message = warp_str_value(&entry->text);
+            if (_conversation.text == NULL) {
+                const res_id_t font = get_dialog_font(_world->get_resources());
+                _conversation.text
+                    = create_label(_world, font, LABEL_POS_LEFT | LABEL_POS_BOTTOM);
+                _conversation.text->receive_message(MSG_PHYSICS_MOVE, vec3(-130 + 16, -64, 8));
+                _conversation.text->receive_message(MSG_PHYSICS_SCALE, vec3(1.6f, 1.6f, 1));
+            }
+            _conversation.text->receive_message(CORE_SHOW_POINTER_TEXT, (void *)message);
+            _conversation.text->receive_message(MSG_GRAPHICS_VISIBLITY, 1);
             
-            chat_entry_evaluate_side_effects(start, &_facts);
-            create_conversation_buttons(start);
+            chat_entry_evaluate_side_effects(_conversation.chat, entry, &_facts);
+            show_conversation_buttons(entry);
         }
 
-        void create_conversation_buttons(const chat_entry_t *entry) {
-            _conversation.buttons_count = entry->responses_count;
-            for (size_t i = 0; i < entry->responses_count; i++) {
+        void show_conversation_buttons(const chat_entry_t *entry) {
+            for (size_t i = 0; i < MAX_CHAT_RESPONSES_COUNT; i++) {
+                entity_t *button = _conversation.buttons[i];
+                if (i >= entry->responses_count) {
+                    hide_widget(button);
+                    continue;
+                }
+
                 const char *resp = warp_str_value(&entry->responses[i].text);
-                const warp_tag_t next_id = entry->responses[i].next_id;
-                const float y = -128.0f + (-96.0f * i);
-                _conversation.buttons[i] = create_text_button
-                    ( _world, vec2(170, y), vec2(600, 64)
-                    , [this, next_id]() { this->update_conversation(next_id); }
-                    , resp, vec4(0, 0, 0, 0.6f)
-                    );
+                _conversation.next_ids[i] = entry->responses[i].next_id;
+                if (button == NULL) {
+                    const float y = -128.0f + (-96.0f * i);
+                    _conversation.buttons[i] = create_text_button
+                        ( _world, vec2(170, y), vec2(600, 64)
+                        , [this, i]() { update_conversation(_conversation.next_ids[i]); }
+                        , resp, vec4(0, 0, 0, 0.6f)
+                        );
+                } else {
+                    button->receive_message(CORE_SHOW_POINTER_TEXT, (void *)resp);
+                    button->receive_message(MSG_GRAPHICS_VISIBLITY, 1);
+                }
             }
         }
 
@@ -532,7 +635,7 @@ class core_controller_t final : public controller_impl_i {
                 save_portal(_world, portal);
                 save_player_state(_world, &_last_player_state);
             }
-            _world->broadcast_message(CORE_SAVE_TO_FILE, 0);
+            _bus->publish(CORE_SAVE_TO_FILE, 0);
         }
         
         void start_level_change(const object_t *player, size_t x, size_t z) {
@@ -581,7 +684,7 @@ class core_controller_t final : public controller_impl_i {
             save_random_seed(_world, new_seed);
             save_facts(_world, &_facts);
 
-            _world->broadcast_message(CORE_SAVE_TO_FILE, 0);
+            _bus->publish(CORE_SAVE_TO_FILE, 0);
         }
 
         const char *get_pain_text() {
@@ -591,7 +694,28 @@ class core_controller_t final : public controller_impl_i {
             return warp_str_value(&text);
         }
 
+        /* NPCs move once the player animation is over, animations that
+         * replace it are waited for too */
+        void wait_for_animation(obj_id_t id) {
+            const object_t *player = _level_state->get_object(id);
+            if (player == NULL || player->entity == NULL) return;
+
+            _waiting_for_animation = _tweens->when_finished
+                (player->entity, TWEEN_POSITION, [this]() { finish_player_turn(); });
+        }
+
+        void finish_player_turn() {
+            if (_state != CSTATE_IDLE || _waiting_for_animation == false) return;
+
+            warp_log_d("NPC turn");
+            _waiting_for_animation = false;
+            next_turn();
+
+            check_events();
+        }
+
         void next_turn() {
+            TRACE_SCOPE("next_turn");
             std::vector<obj_id_t> characters;
             _level_state->find_all_characters(&characters);
             message_t next_turn(CORE_NEXT_TURN, (void *)_level_state);
@@ -611,7 +735,7 @@ extern entity_t *create_core(world_t *world, const portal_t *start) {
     controller_comp_t *controller = world->create_controller();
     controller->initialize(new core_controller_t(start));
 
-    entity_t *entity = world->create_entity(vec3(0, 0, 0), NULL, NULL, controller);
+    entity_t *entity = create_game_entity(world, vec3(0, 0, 0), NULL, NULL, controller);
     entity->set_tag(WARP_TAG("core"));
 
     return entity;
@@ -22,15 +22,12 @@ enum core_msgs_t : unsigned int {
     CORE_DO_ROTATE,
     CORE_DO_FALL,
 
-    CORE_MOVE_DONE,
-
     CORE_NEXT_TURN,
     CORE_AI_COMMAND,
 
     CORE_INPUT_ENABLE_SHOOTING,
 
     CORE_FEAT_STATE_CHANGE,
-    CORE_BULLET_HIT,
 
     CORE_SHOW_KNOWN_TEXT,
     CORE_SHOW_TAG_TEXT,
@@ -44,6 +41,8 @@ enum core_msgs_t : unsigned int {
     CORE_SAVE_FACTS,
     CORE_SAVE_RESET_DEFAULTS,
     CORE_SAVE_TO_FILE,
+
+    CORE_MSGS_END, /* not a message, bounds the range of core messages */
 };
 
 enum move_dir_t : int {
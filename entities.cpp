@@ -0,0 +1,27 @@
+#define WARP_DROP_PREFIX
+#include "entities.h"
+
+#include "warp/world.h"
+#include "warp/entity.h"
+
+#include "perf.h"
+
+using namespace warp;
+
+extern entity_t *create_game_entity
+        ( world_t *world, vec3_t position
+        , graphics_comp_t *graphics, physics_comp_t *physics
+        , controller_comp_t *controller
+        ) {
+    entity_t *entity = world->create_entity(position, graphics, physics, controller);
+    if (entity != NULL) {
+        PERF_ADD(PERF_ENTITIES_CREATED, 1);
+    }
+    return entity;
+}
+
+extern void destroy_game_entity(world_t *world, entity_t *entity) {
+    if (entity == NULL) return;
+    world->destroy_later(entity);
+    PERF_ADD(PERF_ENTITIES_DESTROYED, 1);
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "warp/math/vec3.h"
+
+namespace warp {
+    class world_t;
+    class entity_t;
+    class graphics_comp_t;
+    class physics_comp_t;
+    class controller_comp_t;
+}
+
+/// Entities of the game are created and destroyed through these, so the
+/// performance overlay counts them in one place. Entities the world drops
+/// on a state change are left out of the destroyed rate, warp tears them
+/// down without telling the game.
+warp::entity_t *create_game_entity
+    ( warp::world_t *world, warp_vec3_t position
+    , warp::graphics_comp_t *graphics, warp::physics_comp_t *physics
+    , warp::controller_comp_t *controller
+    );
+void destroy_game_entity(warp::world_t *world, warp::entity_t *entity);
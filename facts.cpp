@@ -0,0 +1,168 @@
+#define WARP_DROP_PREFIX
+#include "facts.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <mutex>
+
+#include "warp/utils/log.h"
+
+using namespace warp;
+
+struct fact_names {
+    /* deque does not move names, so pointers to them stay valid */
+    std::deque<std::string> names;
+    std::unordered_map<std::string, fact_id_t> ids;
+    std::mutex mutex;
+};
+
+static fact_names_t shared_names;
+
+extern fact_names_t *fact_names_create(void) {
+    return new fact_names_t;
+}
+
+extern void fact_names_destroy(fact_names_t *names) {
+    if (names == &shared_names) return;
+    delete names;
+}
+
+extern fact_names_t *fact_get_shared_names(void) {
+    return &shared_names;
+}
+
+extern fact_id_t fact_names_intern(fact_names_t *names, const char *name) {
+    if (name == NULL) {
+        warp_log_e("Cannot intern null fact name.");
+        return FACT_ID_INVALID;
+    }
+
+    std::lock_guard<std::mutex> lock(names->mutex);
+    auto found = names->ids.find(name);
+    if (found != names->ids.end()) {
+        return found->second;
+    }
+
+    const fact_id_t id = names->names.size();
+    names->names.push_back(name);
+    names->ids.insert(std::make_pair(names->names.back(), id));
+    return id;
+}
+
+extern const char *fact_names_get(fact_names_t *names, fact_id_t id) {
+    std::lock_guard<std::mutex> lock(names->mutex);
+    if (id >= names->names.size()) {
+        warp_log_e("Cannot get name of unknown fact: %u.", id);
+        return NULL;
+    }
+    return names->names[id].c_str();
+}
+
+extern fact_id_t fact_intern(const char *name) {
+    return fact_names_intern(&shared_names, name);
+}
+
+extern fact_id_t fact_lookup(const char *name) {
+    if (name == NULL) return FACT_ID_INVALID;
+
+    std::lock_guard<std::mutex> lock(shared_names.mutex);
+    auto found = shared_names.ids.find(name);
+    return found == shared_names.ids.end() ? FACT_ID_INVALID : found->second;
+}
+
+extern const char *fact_get_name(fact_id_t id) {
+    return fact_names_get(&shared_names, id);
+}
+
+extern size_t fact_get_names_count(void) {
+    std::lock_guard<std::mutex> lock(shared_names.mutex);
+    return shared_names.names.size();
+}
+
+extern void fact_set_init(fact_set_t *set) {
+    set->values = NULL;
+    set->stamps = NULL;
+    set->count = 0;
+    set->stamp = 0;
+}
+
+extern void fact_set_destroy(fact_set_t *set) {
+    if (set == NULL) return;
+    free(set->values);
+    free(set->stamps);
+    fact_set_init(set);
+}
+
+static bool reserve(fact_set_t *set, size_t count) {
+    if (count <= set->count) return true;
+
+    /* names are interned in bulk when chats load, grow to all of them */
+    const size_t names_count = fact_get_names_count();
+    const size_t new_count = names_count > count ? names_count : count;
+    int *values = (int *) realloc(set->values, new_count * sizeof *values);
+    if (values != NULL) {
+        set->values = values;
+    }
+    uint32_t *stamps = (uint32_t *) realloc(set->stamps, new_count * sizeof *stamps);
+    if (stamps != NULL) {
+        set->stamps = stamps;
+    }
+    if (values == NULL || stamps == NULL) {
+        warp_log_e("Failed to grow fact set to %zu facts.", new_count);
+        return false;
+    }
+
+    const size_t added = new_count - set->count;
+    memset(values + set->count, 0, added * sizeof *values);
+    memset(stamps + set->count, 0, added * sizeof *stamps);
+    set->count = new_count;
+    return true;
+}
+
+extern int fact_set_get(const fact_set_t *set, fact_id_t id) {
+    return id < set->count ? set->values[id] : 0;
+}
+
+extern uint32_t fact_set_get_stamp(const fact_set_t *set, fact_id_t id) {
+    return id < set->count ? set->stamps[id] : 0;
+}
+
+extern void fact_set_set(fact_set_t *set, fact_id_t id, int value) {
+    if (id == FACT_ID_INVALID) return;
+    if (fact_set_get(set, id) == value) return;
+    if (reserve(set, (size_t)id + 1)) {
+        set->values[id] = value;
+        set->stamps[id] = ++set->stamp;
+    }
+}
+
+/* values are replaced in bulk, so all facts are stamped as changed */
+static void stamp_all(fact_set_t *set) {
+    set->stamp += 1;
+    for (size_t i = 0; i < set->count; i++) {
+        set->stamps[i] = set->stamp;
+    }
+}
+
+extern void fact_set_clear(fact_set_t *set) {
+    if (set->count == 0) return;
+    memset(set->values, 0, set->count * sizeof *set->values);
+    stamp_all(set);
+}
+
+extern void fact_set_copy(fact_set_t *destination, const fact_set_t *source) {
+    if (destination == source) return;
+    if (reserve(destination, source->count) == false) return;
+
+    const size_t size = source->count * sizeof *source->values;
+    if (size > 0) {
+        memcpy(destination->values, source->values, size);
+    }
+    const size_t rest = destination->count - source->count;
+    memset(destination->values + source->count, 0, rest * sizeof *destination->values);
+    stamp_all(destination);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Fact names are interned to slots of a dense array of values, names are
+ * needed only to save and load facts. Interning is thread-safe. */
+
+typedef uint32_t fact_id_t;
+
+#define FACT_ID_INVALID ((fact_id_t)-1)
+
+fact_id_t fact_intern(const char *name);
+/* FACT_ID_INVALID when name was never interned: */
+fact_id_t fact_lookup(const char *name);
+const char *fact_get_name(fact_id_t id);
+size_t fact_get_names_count(void);
+
+/* The functions above use the table shared by the game, separate tables
+ * keep names that should not end up in it, like benchmark facts: */
+typedef struct fact_names fact_names_t;
+
+fact_names_t *fact_names_create(void);
+void fact_names_destroy(fact_names_t *names);
+fact_names_t *fact_get_shared_names(void);
+fact_id_t fact_names_intern(fact_names_t *names, const char *name);
+const char *fact_names_get(fact_names_t *names, fact_id_t id);
+
+/* Every change of a value gets a new stamp, readers compare stamps to see
+ * which facts changed since they last looked: */
+typedef struct fact_set {
+    int *values;
+    uint32_t *stamps;
+    size_t count;
+    uint32_t stamp; /* of the latest change */
+} fact_set_t;
+
+void fact_set_init(fact_set_t *set);
+void fact_set_destroy(fact_set_t *set);
+/* Facts that were never set are zero: */
+int fact_set_get(const fact_set_t *set, fact_id_t id);
+uint32_t fact_set_get_stamp(const fact_set_t *set, fact_id_t id);
+void fact_set_set(fact_set_t *set, fact_id_t id, int value);
+void fact_set_clear(fact_set_t *set);
+void fact_set_copy(fact_set_t *destination, const fact_set_t *source);
+
+#ifdef __cplusplus
+}
+#endif
@@ -9,13 +9,27 @@
 #include "warp/entity-helpers.h"
 
 #include "core.h"
+#include "tweens.h"
 
 using namespace warp;
 
 static const float DOOR_MOVE_TIME = 0.1f;
+static const float DOOR_OPEN_DEPTH = -0.85f;
 
 class door_controller_t final : public controller_impl_i {
     public:
+        door_controller_t()
+            : _owner(nullptr)
+            , _world(nullptr)
+            , _tweens()
+        { }
+
+        ~door_controller_t() {
+            if (_tweens != nullptr) {
+                _tweens->stop_all(_owner);
+            }
+        }
+
         dynval_t get_property(const warp_tag_t &) const override {
             return dynval_t::make_null();
         }
@@ -23,25 +37,10 @@ class door_controller_t final : public controller_impl_i {
         void initialize(entity_t *owner, world_t *world) override {
             _owner = owner;
             _world = world;
-            _state = false;
-            _timer = 0;
+            _tweens = get_tweens(world)->shared_from_this();
         }
 
-        void update(float dt, const input_t &) override { 
-            if (_timer <= 0) {
-                _timer = 0;
-                return;
-            } 
-
-            _timer -= dt;
-            const float t = _timer / DOOR_MOVE_TIME;
-
-            if (_state) {
-                update_opening(t);
-            } else {
-                update_closing(t);
-            }
-        }
+        void update(float, const input_t &) override { }
 
         void handle_message(const message_t &message) override {
             const messagetype_t type = message.type;
@@ -54,27 +53,20 @@ class door_controller_t final : public controller_impl_i {
     private:
         entity_t *_owner;
         world_t *_world;
-        float _timer;
-        bool _state;
-
-        void change_state(bool state) {
-            _state = state;
-            _timer = DOOR_MOVE_TIME;
-            _owner->receive_message(MSG_PHYSICS_TOGGLE_ENABLED, 1 - (int)state);
-        }
-
-        void update_closing(float t) {
-            const float scale = -0.85f * ease_cubic(t);
-            const vec3_t position = _owner->get_position();
-            const vec3_t pos = vec3(position.x, scale, position.z);
-            _owner->receive_message(MSG_PHYSICS_MOVE, pos);
-        }
+        std::shared_ptr<tween_system_t> _tweens;
 
-        void update_opening(float t) {
-            const float scale = -0.85f * ease_cubic(1 - t);
+        void change_state(bool open) {
             const vec3_t position = _owner->get_position();
-            const vec3_t pos = vec3(position.x, scale, position.z);
-            _owner->receive_message(MSG_PHYSICS_MOVE, pos);
+            const vec3_t closed = vec3(position.x, 0, position.z);
+            const vec3_t opened = vec3(position.x, DOOR_OPEN_DEPTH, position.z);
+            const tween_def_t def = open
+                ? tween_def_t { TWEEN_POSITION, TWEEN_CUBIC, TWEEN_CUBIC
+                              , closed, opened, DOOR_MOVE_TIME
+                              }
+                : tween_def_t { TWEEN_POSITION, TWEEN_CUBIC_OUT, TWEEN_CUBIC_OUT
+                              , opened, closed, DOOR_MOVE_TIME
+                              };
+            _tweens->start(_owner, def);
         }
 };
 
@@ -11,6 +11,8 @@
 
 #include "core.h"
 #include "button.h"
+#include "message_bus.h"
+#include "entities.h"
 
 using namespace warp;
 
@@ -41,6 +43,7 @@ class input_controller_t final : public controller_impl_i {
         void initialize(entity_t *owner, world_t *world) override {
             _owner = owner;
             _world = world;
+            _bus = get_message_bus(world);
 
             _screen_size = vec2(1, 1);
             
@@ -143,6 +146,7 @@ class input_controller_t final : public controller_impl_i {
     private:
         entity_t *_owner;
         world_t *_world;
+        message_bus_t *_bus;
         vec2_t _screen_size;
 
         bool _is_shooting_enabled;
@@ -195,13 +199,13 @@ class input_controller_t final : public controller_impl_i {
         
         void move(move_dir_t direction) {
             if (direction != MOVE_NONE) {
-                _world->broadcast_message(CORE_TRY_MOVE, (int)direction);
+                _bus->publish(CORE_TRY_MOVE, (int)direction);
             }
         }
 
         void shoot(move_dir_t direction) {
             if (direction != MOVE_NONE) {
-                _world->broadcast_message(CORE_TRY_SHOOT, (int)direction);
+                _bus->publish(CORE_TRY_SHOOT, (int)direction);
             }
         }
 };
@@ -217,7 +221,8 @@ entity_t *create_input_controller(world_t *world) {
     controller_comp_t *controller = world->create_controller();
     controller->initialize(new input_controller_t);
 
-    entity_t *entity = world->create_entity(ATTACK_POSITION, graphics, NULL, controller);
+    entity_t *entity
+        = create_game_entity(world, ATTACK_POSITION, graphics, NULL, controller);
     entity->set_tag(WARP_TAG("input"));
     return entity;
 }
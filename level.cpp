@@ -1,6 +1,9 @@
 #define WARP_DROP_PREFIX
 #include "level.h"
 
+#include <math.h> /* ceilf */
+#include <vector>
+
 #include "warp/math/utils.h"
 #include "warp/world.h"
 #include "warp/entity.h"
@@ -10,23 +13,104 @@
 #include "warp/components.h"
 
 #include "region.h"
+#include "trace.h"
+#include "entities.h"
 
 using namespace warp;
 
+static bool are_tiles_equal(const tile_t *a, const tile_t *b) {
+    return a->is_walkable == b->is_walkable
+        && a->is_stairs == b->is_stairs
+        && a->spawn_probablity == b->spawn_probablity
+        && warp_tag_equals(&a->object_id, &b->object_id)
+        && a->object_dir == b->object_dir
+        && a->feature == b->feature
+        && a->feat_target_id == b->feat_target_id
+        && a->portal_id == b->portal_id
+        && a->graphics_id == b->graphics_id;
+}
+
+/* object id is left out, equal tiles only have to hash equally */
+static uint32_t hash_tile(const tile_t *tile) {
+    uint32_t hash = 2166136261u;
+    const uint32_t values[] = 
+        { tile->is_walkable, tile->is_stairs, (uint32_t)tile->object_dir
+        , (uint32_t)tile->feature, (uint32_t)tile->feat_target_id
+        , (uint32_t)tile->portal_id, tile->graphics_id
+        , (uint32_t)(tile->spawn_probablity * 1024)
+        };
+    for (uint32_t value : values) {
+        hash = (hash ^ value) * 16777619u;
+    }
+    return hash;
+}
+
+const tile_t *tile_palette_t::intern(const tile_t *tile) {
+    const uint32_t hash = hash_tile(tile);
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto range = _lookup.equal_range(hash);
+    for (auto it = range.first; it != range.second; it++) {
+        if (are_tiles_equal(it->second, tile)) {
+            return it->second;
+        }
+    }
+
+    _prototypes.push_back(*tile);
+    const tile_t *prototype = &_prototypes.back();
+    _lookup.insert(std::make_pair(hash, prototype));
+    return prototype;
+}
+
+size_t tile_palette_t::get_size() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _prototypes.size();
+}
+
+static const size_t MAX_LEVEL_PALETTE_SIZE = 256;
+
+/* meshes of released levels, only touched on the main thread */
+static std::vector<res_id_t> free_level_meshes;
+
 level_t::level_t( const tile_t *tiles, size_t width, size_t height
                 , const decoration_t *decors, size_t decors_count
+                , tile_palette_t *palette
                 ) 
         : _initialized(false)
         , _width(width)
         , _height(height)
         , _decors_count(decors_count)
-        , _tiles(NULL) 
+        , _cells(NULL) 
+        , _palette(NULL) 
+        , _palette_size(0) 
         , _decors(NULL) 
-        , _entity(NULL) {
+        , _entity(NULL)
+        , _mesh_id(0)
+        , _mesh_size(0) {
     const size_t tiles_count = _width * _height;
-    const size_t tile_size = sizeof *_tiles;
-    _tiles = (tile_t *) calloc(tiles_count, tile_size);
-    memmove(_tiles, tiles, tiles_count * tile_size);
+    _cells = (uint8_t *) calloc(tiles_count, sizeof *_cells);
+
+    const tile_t *used[MAX_LEVEL_PALETTE_SIZE];
+    for (size_t i = 0; i < tiles_count; i++) {
+        const tile_t *prototype = palette->intern(tiles + i);
+
+        size_t index = 0;
+        while (index < _palette_size && used[index] != prototype) {
+            index++;
+        }
+        if (index == _palette_size) {
+            if (_palette_size == MAX_LEVEL_PALETTE_SIZE) {
+                warp_log_e("Level uses too many distinct tiles.");
+                index = 0;
+            } else {
+                used[_palette_size++] = prototype;
+            }
+        }
+        _cells[i] = index;
+    }
+
+    _palette = (const tile_t **) calloc(_palette_size, sizeof *_palette);
+    memmove(_palette, used, _palette_size * sizeof *_palette);
 
     if (decors) {
         _decors = (decoration_t *) calloc(_decors_count, sizeof *_decors);
@@ -35,10 +119,22 @@ level_t::level_t( const tile_t *tiles, size_t width, size_t height
 }
 
 level_t::~level_t() {
-    free(_tiles);
+    /* dropped without release, the entity goes away with its world */
+    if (_mesh_id != 0) {
+        free_level_meshes.push_back(_mesh_id);
+    }
+    free(_cells);
+    free(_palette);
     free(_decors);
 }
 
+size_t level_t::get_memory_size() const {
+    return sizeof *this
+         + _width * _height * sizeof *_cells
+         + _palette_size * sizeof *_palette
+         + _decors_count * sizeof *_decors;
+}
+
 void level_t::set_display_position(const vec3_t pos) {
     if (_initialized == false) return;
     _entity->receive_message(MSG_PHYSICS_MOVE, pos);
@@ -59,7 +155,7 @@ const tile_t *level_t::get_tile_at(int x, int y) const {
         return NULL;
     }
     
-    return _tiles + (x + _width * y);
+    return _palette[_cells[x + _width * y]];
 }
 
 bool level_t::is_point_walkable(const vec3_t point) const {
@@ -92,24 +188,22 @@ bool level_t::scan_if_all
 
 static void append_graphics
         ( mesh_builder_t *builder
-        , resources_t *res
-        , const warp_tag_t *name
+        , graphics_id_t graphics_id
         , const transforms_t *transforms
         , const region_t *owner
         ) {
-    const tile_graphics_t *graphics = owner->get_tile_graphics(*name);
-    if (graphics == NULL) {
-        warp_log_e("Failed to get tile graphics with id: %s.", name->text);
+    if (graphics_id == GRAPHICS_ID_INVALID) return;
+
+    const res_id_t id = owner->get_graphics_mesh(graphics_id);
+    if (id == WARP_RES_ID_INVALID) {
+        warp_log_e("Failed to get tile graphics with id: %d.", (int)graphics_id);
         return;
     }
-    const char *mesh_name = warp_str_value(&graphics->mesh);
-    const res_id_t id = warp_resources_load(res, mesh_name);
     mesh_builder_append(builder, id, transforms);
 }
 
 static void append_tile
         ( mesh_builder_t *builder
-        , resources_t *res
         , const tile_t *tile
         , size_t x, size_t y
         , const region_t *owner
@@ -120,52 +214,105 @@ static void append_tile
     if (tile->is_stairs || tile->is_walkable) {
         transforms_change_rotation(&transforms, quat_from_euler(0, PI, 0));
     }
-    append_graphics(builder, res, &tile->graphics_id, &transforms, owner);
+    append_graphics(builder, tile->graphics_id, &transforms, owner);
 }
 
 static int level_mesh_numer = 0;
 
+/* refills a released mesh when there is one, resources are never unloaded */
+static res_id_t upload_level_mesh(resources_t *res, mesh_builder_t *builder) {
+    if (free_level_meshes.empty() == false) {
+        const size_t count = warp_array_get_size(&builder->vertices);
+        const vertex_t *vertices = (vertex_t *) warp_array_get(&builder->vertices, 0);
+        const res_id_t mesh_id = free_level_meshes.back();
+        free_level_meshes.pop_back();
+        warp_mesh_resource_mutate(res, mesh_id, vertices, count);
+        return mesh_id;
+    }
+
+    warp_str_t name = warp_str_format("level-%d", level_mesh_numer++);
+    const res_id_t mesh_id = mesh_builder_create_resource(builder, warp_str_value(&name));
+    warp_str_destroy(&name);
+    return mesh_id;
+}
+
 void level_t::initialize(world_t *world, const region_t *owner) {
+    TRACE_SCOPE("level_t::initialize");
     if (_initialized) {
         warp_log_e("Level is already initialized.");
         return;
     }
     
-    resources_t *res = world->get_resources();
     mesh_builder_t builder;
-    warp_mesh_builder_init(&builder, res);
+    warp_mesh_builder_init(&builder, world->get_resources());
+
+    assemble_mesh(&builder, owner);
+    initialize_from_mesh(world, &builder);
+
+    warp_mesh_builder_destroy(&builder);
+}
 
+void level_t::assemble_mesh(mesh_builder_t *builder, const region_t *owner) const {
     for (int j = _height - 1; j >= 0; j--) {
         for (int i = _width - 1; i >= 0; i--) {
-            const tile_t *tile = _tiles + (i + _width * j);
-            append_tile(&builder, res, tile, i, j, owner);
+            const tile_t *tile = _palette[_cells[i + _width * j]];
+            append_tile(builder, tile, i, j, owner);
         }
     }
 
     for (size_t i = 0; i < _decors_count; i++) {
         const decoration_t *decor = _decors + i;
-        append_graphics( &builder, res
-                       , &decor->graphics_id, &decor->transforms, owner
-                       );
+        append_graphics(builder, decor->graphics_id, &decor->transforms, owner);
     }
+}
 
-    warp_str_t name = warp_str_format("level-%d", level_mesh_numer++);
-    const res_id_t mesh_id = mesh_builder_create_resource(&builder, warp_str_value(&name));
+void level_t::initialize_from_mesh(world_t *world, mesh_builder_t *builder) {
+    if (_initialized) {
+        warp_log_e("Level is already initialized.");
+        return;
+    }
+
+    resources_t *res = world->get_resources();
+    _mesh_id = upload_level_mesh(res, builder);
+    _mesh_size = warp_array_get_size(&builder->vertices) * sizeof (vertex_t);
     const res_id_t tex_id  = resources_load(res, "atlas.png");
     graphics_comp_t *graphics = world->create_graphics();
 
-    warp_str_destroy(&name);
-
     model_t model;
-    model_init(&model, mesh_id, tex_id);
+    model_init(&model, _mesh_id, tex_id);
     
     graphics->add_model(model);
 
-    _entity = world->create_entity(vec3(0, 0, 0), graphics, NULL, NULL);
+    _entity = create_game_entity(world, vec3(0, 0, 0), graphics, NULL, NULL);
     _entity->set_tag(WARP_TAG("level"));
     
     _initialized = true;
-    warp_mesh_builder_destroy(&builder);
+}
+
+void level_t::release(world_t *world) {
+    if (_initialized == false) return;
+
+    destroy_game_entity(world, _entity);
+    _entity = NULL;
+    _initialized = false;
+
+    free_level_meshes.push_back(_mesh_id);
+    _mesh_id = 0;
+    _mesh_size = 0;
+}
+
+extern void fill_default_tile(tile_t *tile) {
+    if (tile == nullptr) return;
+
+    tile->is_walkable = true;
+    tile->is_stairs = false;
+    tile->spawn_probablity = 0;
+    tile->object_dir = DIR_NONE;
+    tile->feature = FEAT_NONE;
+    tile->feat_target_id = 0;
+    tile->portal_id = 0;
+    tile->object_id = WARP_TAG("");
+    tile->graphics_id = GRAPHICS_ID_INVALID;
 }
 
 static void fill_empty_room(tile_t *tiles, size_t width, size_t height) {
@@ -174,15 +321,13 @@ static void fill_empty_room(tile_t *tiles, size_t width, size_t height) {
         for (size_t j = 0; j < height; j++) {
             bool is_wall = i == 0 || j == 0 || i == width - 1 || j == height - 1;
             const size_t index = i + width * j;
+            fill_default_tile(tiles + index);
 			tiles[index].is_walkable = is_wall == false;
-			tiles[index].is_stairs = false;
-            tiles[index].spawn_probablity = 0;
-            tiles[index].feature = FEAT_NONE;
         }
     }
 }
 
-extern level_t *generate_test_level() {
+extern level_t *generate_test_level(tile_palette_t *palette) {
     const size_t width = 13;
     const size_t height = 11;
     const size_t count = width * height;
@@ -210,10 +355,13 @@ extern level_t *generate_test_level() {
 
     tiles[7 + width * 4].feature = FEAT_DOOR;
 
-    return new (std::nothrow) level_t(tiles, width, height, NULL, 0);
+    return new (std::nothrow) level_t(tiles, width, height, NULL, 0, palette);
 }
 
-extern level_t *generate_random_level(warp_random_t *random) {
+static const float SPAWN_PROBABILITY_STEPS = 8;
+
+extern level_t *generate_random_level
+        (warp_random_t *random, tile_palette_t *palette) {
     const size_t width = 13;
     const size_t height = 11;
     const size_t count = width * height;
@@ -229,7 +377,10 @@ extern level_t *generate_random_level(warp_random_t *random) {
                 const bool is_floor = warp_random_boolean(random);
                 tiles[index].is_walkable = is_floor;
                 if (is_floor && warp_random_float(random) < 0.05f) {
-                    tiles[index].spawn_probablity = warp_random_float(random);
+                    /* few distinct values keep the region palette small */
+                    const float p = warp_random_float(random);
+                    const float steps = SPAWN_PROBABILITY_STEPS;
+                    tiles[index].spawn_probablity = ceilf(p * steps) / steps;
                 }  
             }
         }
@@ -247,5 +398,5 @@ extern level_t *generate_random_level(warp_random_t *random) {
     tiles[12 + width * 5].is_walkable = true;
     tiles[11 + width * 5].is_walkable = true;
 
-    return new (std::nothrow) level_t(tiles, width, height, NULL, 0);
+    return new (std::nothrow) level_t(tiles, width, height, NULL, 0, palette);
 }
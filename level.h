@@ -6,8 +6,13 @@
 #include "warp/utils/directions.h"
 
 #include "warp/utils/random.h"
+#include "warp/graphics/mesh-builder.h"
 
 #include <functional>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+#include <stdint.h>
 
 namespace warp {
     class entity_t;
@@ -22,6 +27,11 @@ enum feature_type_t : int {
     FEAT_BREAKABLE_FLOOR,
 };
 
+/// Index into the graphics table of the region owning the level.
+typedef uint16_t graphics_id_t;
+
+#define GRAPHICS_ID_INVALID UINT16_MAX
+
 struct tile_t {
     bool is_walkable;
     bool is_stairs;
@@ -33,11 +43,25 @@ struct tile_t {
     feature_type_t feature;
     size_t feat_target_id;
     size_t portal_id;
-    warp_tag_t graphics_id;
+    graphics_id_t graphics_id;
+};
+
+/// Deduplicated tiles shared by levels of a region, prototypes never move
+/// once added, so levels keep pointers to them.
+class tile_palette_t {
+    public:
+        /// Returns prototype equal to tile, safe to call from worker threads.
+        const tile_t *intern(const tile_t *tile);
+        size_t get_size();
+
+    private:
+        std::mutex _mutex;
+        std::deque<tile_t> _prototypes;
+        std::unordered_multimap<uint32_t, const tile_t *> _lookup;
 };
 
 struct decoration_t {
-    warp_tag_t graphics_id;
+    graphics_id_t graphics_id;
     warp_transforms_t transforms;
 };
 
@@ -45,12 +69,25 @@ class region_t;
 
 class level_t {
     public:
+        /// Tiles are interned in the palette, which must outlive the level.
         level_t( const tile_t *tiles, size_t width, size_t height  
                , const decoration_t *decors, size_t decors_count
+               , tile_palette_t *palette
                );
         ~level_t();
 
         void initialize(warp::world_t *world, const region_t *owner);
+        /// Appends level geometry to the builder, safe to call from worker
+        /// threads as long as owner's graphics are already resolved.
+        void assemble_mesh
+            (warp_mesh_builder_t *builder, const region_t *owner) const;
+        /// Uploads assembled geometry and creates the level entity, must be
+        /// called on the main thread.
+        void initialize_from_mesh
+            (warp::world_t *world, warp_mesh_builder_t *builder);
+        /// Destroys level entity, the level can be initialized again. Its
+        /// mesh is handed to the next initialized level.
+        void release(warp::world_t *world);
         void set_display_position(const warp_vec3_t pos);
         void set_visiblity(bool visible);
 
@@ -58,6 +95,9 @@ class level_t {
         inline size_t get_width() const { return _width; }
         inline size_t get_height() const { return _height; }
         inline warp::entity_t *get_entity() const { return _entity; }
+        size_t get_memory_size() const;
+        /// Bytes of vertices uploaded for the level, zero if uninitialized.
+        inline size_t get_mesh_size() const { return _mesh_size; }
 
         const tile_t *get_tile_at(int x, int y) const;
 
@@ -75,11 +115,18 @@ class level_t {
         size_t _height;
         size_t _decors_count;
 
-        tile_t *_tiles;
+        uint8_t *_cells; /* indices into _palette */
+        const tile_t **_palette;
+        size_t _palette_size;
         decoration_t *_decors;
         warp::entity_t *_entity;
+        warp_res_id_t _mesh_id;
+        size_t _mesh_size;
 };
 
+/// Fills tile with values used for properties missing in level files.
+void fill_default_tile(tile_t *tile);
+
 /// Generates uninitialized level instance.
-level_t *generate_test_level();
-level_t *generate_random_level(warp_random_t *random);
+level_t *generate_test_level(tile_palette_t *palette);
+level_t *generate_random_level(warp_random_t *random, tile_palette_t *palette);
@@ -0,0 +1,143 @@
+#define WARP_DROP_PREFIX
+#include "level_generator.h"
+
+#include <stdlib.h> /* llabs */
+
+#include "warp/utils/log.h"
+#include "warp/utils/random.h"
+
+using namespace warp;
+
+/* difference of wrapped coordinates is interpreted as a signed number */
+extern size_t get_level_distance(size_t a, size_t b) {
+    return llabs((long long)(ptrdiff_t)(a - b));
+}
+
+static bool is_within
+        (size_t x, size_t z, size_t center_x, size_t center_z, size_t radius) {
+    return get_level_distance(x, center_x) <= radius
+        && get_level_distance(z, center_z) <= radius;
+}
+
+static uint32_t mix_bits(uint32_t h) {
+    h ^= h >> 16;
+    h *= 0x7feb352d;
+    h ^= h >> 15;
+    h *= 0x846ca68b;
+    h ^= h >> 16;
+    return h;
+}
+
+static uint32_t get_level_seed(uint32_t seed, size_t x, size_t z) {
+    uint32_t h = mix_bits(seed);
+    h = mix_bits(h ^ (uint32_t)x);
+    h = mix_bits(h ^ (uint32_t)z);
+    return h;
+}
+
+extern level_t *generate_level_at
+        (uint32_t seed, size_t x, size_t z, tile_palette_t *palette) {
+    warp_random_t *random = warp_random_create(get_level_seed(seed, x, z));
+    level_t *level = generate_random_level(random, palette);
+    warp_random_destroy(random);
+    return level;
+}
+
+extern void destroy_generated_level(generated_level_t *generated) {
+    if (generated == NULL) return;
+    warp_mesh_builder_destroy(&generated->builder);
+    delete generated->level;
+    generated->level = NULL;
+}
+
+level_generator_t::level_generator_t
+        ( uint32_t seed, resources_t *res, const region_t *owner
+        , tile_palette_t *palette
+        )
+        : _seed(seed)
+        , _res(res)
+        , _owner(owner)
+        , _palette(palette)
+        , _running(true)
+        , _queue()
+        , _requested()
+        , _finished()
+        , _mutex()
+        , _wake()
+        , _thread() {
+    _thread = std::thread(&level_generator_t::run, this);
+}
+
+level_generator_t::~level_generator_t() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _running = false;
+        _queue.clear();
+    }
+    _wake.notify_one();
+    _thread.join();
+
+    for (generated_level_t &generated : _finished) {
+        destroy_generated_level(&generated);
+    }
+}
+
+void level_generator_t::request(size_t x, size_t z) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_requested.insert(std::make_pair(x, z)).second == false) return;
+
+    generated_level_t generated;
+    generated.x = x;
+    generated.z = z;
+    generated.level = NULL;
+    _queue.push_back(generated);
+    _wake.notify_one();
+}
+
+void level_generator_t::retain(size_t x, size_t z, size_t radius) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto it = _queue.begin(); it != _queue.end();) {
+        if (is_within(it->x, it->z, x, z, radius)) {
+            it++;
+        } else {
+            _requested.erase(std::make_pair(it->x, it->z));
+            it = _queue.erase(it);
+        }
+    }
+}
+
+void level_generator_t::collect(std::vector<generated_level_t> *output) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (const generated_level_t &generated : _finished) {
+        _requested.erase(std::make_pair(generated.x, generated.z));
+    }
+    output->insert(output->end(), _finished.begin(), _finished.end());
+    _finished.clear();
+}
+
+void level_generator_t::generate
+        (size_t x, size_t z, generated_level_t *output) const {
+    output->x = x;
+    output->z = z;
+    output->level = generate_level_at(_seed, x, z, _palette);
+    warp_mesh_builder_init(&output->builder, _res);
+    output->level->assemble_mesh(&output->builder, _owner);
+}
+
+void level_generator_t::run() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true) {
+        _wake.wait(lock, [this]() { return _running == false || _queue.empty() == false; });
+        if (_running == false) break;
+
+        const generated_level_t request = _queue.front();
+        _queue.pop_front();
+
+        lock.unlock();
+        generated_level_t generated;
+        generate(request.x, request.z, &generated);
+        lock.lock();
+
+        _finished.push_back(generated);
+    }
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <vector>
+#include <deque>
+#include <set>
+#include <utility>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "warp/resources/resources.h"
+#include "warp/graphics/mesh-builder.h"
+
+#include "level.h"
+
+/// Level generated off the main thread, its geometry is already assembled
+/// and only has to be uploaded with level_t::initialize_from_mesh.
+struct generated_level_t {
+    size_t x, z;
+    level_t *level;
+    warp_mesh_builder_t builder;
+};
+
+/// Distance along one axis of unbounded region, coordinates wrap around.
+size_t get_level_distance(size_t a, size_t b);
+
+/// Releases level and builder of a result that will not be used.
+void destroy_generated_level(generated_level_t *generated);
+
+/// Generates level at given coordinates, the same seed and coordinates
+/// always give the same level.
+level_t *generate_level_at
+    (uint32_t seed, size_t x, size_t z, tile_palette_t *palette);
+
+/// Generates levels of an unbounded region on a background thread.
+class level_generator_t {
+    public:
+        level_generator_t
+            ( uint32_t seed, warp_resources_t *res, const region_t *owner
+            , tile_palette_t *palette
+            );
+        ~level_generator_t();
+
+        /// Queues level for generation, requests for levels that are queued,
+        /// being generated or not collected yet are ignored.
+        void request(size_t x, size_t z);
+        /// Forgets queued requests further than radius from x, z.
+        void retain(size_t x, size_t z, size_t radius);
+        /// Moves levels finished since the last call to output.
+        void collect(std::vector<generated_level_t> *output);
+        /// Generates level on the calling thread.
+        void generate(size_t x, size_t z, generated_level_t *output) const;
+
+    private:
+        void run();
+
+    private:
+        uint32_t _seed;
+        warp_resources_t *_res;
+        const region_t *_owner;
+        tile_palette_t *_palette;
+
+        bool _running;
+        std::deque<generated_level_t> _queue;
+        std::set<std::pair<size_t, size_t>> _requested; /* until collected */
+        std::vector<generated_level_t> _finished;
+        std::mutex _mutex;
+        std::condition_variable _wake;
+        std::thread _thread;
+};
@@ -12,31 +12,24 @@
 #include "features.h"
 #include "bullets.h"
 #include "object_factory.h"
+#include "entities.h"
+#include "perf.h"
+#include "trace.h"
 
 using namespace warp;
 
-static physics_comp_t *create_object_physics(world_t *world, vec2_t size) {
-    physics_comp_t *physics = world->create_physics();
-    if (physics != NULL) {
-        physics->_flags = PHYSFLAGS_FIXED;
-        physics->_velocity = vec3(0, 0, 0);
-        aabb_init(&physics->_bounds, vec3(0, 0, 0), vec3(size.x, 1, size.y));
-    }
-    return physics;
-}
-
 static entity_t *create_button_entity
         (vec3_t position, world_t *world) {
     graphics_comp_t *graphics
         = create_single_model_graphics(world, "button.obj", "missing.png");
-    return world->create_entity(position, graphics, NULL, NULL);
+    return create_game_entity(world, position, graphics, NULL, NULL);
 }
 
 static entity_t *create_spikes_entity
         (vec3_t position, world_t *world) {
     graphics_comp_t *graphics
         = create_single_model_graphics(world, "spikes.obj", "atlas.png");
-    return world->create_entity(position, graphics, NULL, NULL);
+    return create_game_entity(world, position, graphics, NULL, NULL);
 }
 
 static entity_t *create_breakable_entity
@@ -44,7 +37,7 @@ static entity_t *create_breakable_entity
     graphics_comp_t *graphics
         = create_single_model_graphics(world, "cracked_floor.obj", "atlas.png");
     controller_comp_t *controller = create_door_controller(world);
-    return world->create_entity(position, graphics, NULL, controller);
+    return create_game_entity(world, position, graphics, NULL, controller);
 }
 
 static entity_t *create_door_entity
@@ -52,9 +45,8 @@ static entity_t *create_door_entity
     graphics_comp_t *graphics
         = create_single_model_graphics(world, "door.obj", "missing.png");
     controller_comp_t *controller = create_door_controller(world);
-    physics_comp_t *physics = create_object_physics(world, vec2(1.0f, 0.4f));
 
-    return world->create_entity(position, graphics, physics, controller);
+    return create_game_entity(world, position, graphics, NULL, controller);
 }
 
 static feature_t *create_feature
@@ -244,15 +236,16 @@ bool level_state_t::can_move_to(vec3_t new_pos) const {
     const obj_id_t object = object_at(x, z);
     if (object != OBJ_ID_INVALID) return false;
 
+    return is_blocked_by_feature(x, z) == false;
+}
+
+/* closed doors block the tile */
+bool level_state_t::is_blocked_by_feature(size_t x, size_t z) const {
     const feat_id_t feature = feature_at(x, z);
-    if (feature != FEAT_ID_INVALID) {
-        const feature_t *feat = get_feature(feature);
-        warp_log_d("feature type: %d", (int)feat->type);
-        if (feat->type == FEAT_DOOR && feat->state == FSTATE_INACTIVE) {
-            return false;
-        }
-    }
-    return true;
+    if (feature == FEAT_ID_INVALID) return false;
+
+    const feature_t *feat = get_feature(feature);
+    return feat->type == FEAT_DOOR && feat->state == FSTATE_INACTIVE;
 }
 
 bool level_state_t::is_object_idle(obj_id_t obj) const {
@@ -270,6 +263,7 @@ bool level_state_t::is_object_valid(obj_id_t obj) const {
 }
 
 void level_state_t::spawn(const level_t *level, warp_random_t *rand) {
+    TRACE_SCOPE("level_state_t::spawn");
     if (level == NULL) {
         warp_log_e("Cannot spawn objects, null level.");
         return;
@@ -322,6 +316,8 @@ void level_state_t::spawn(const level_t *level, warp_random_t *rand) {
 }
 
 bool level_state_t::apply_command(const command_t *cmd) {
+    TRACE_SCOPE("level_state_t::apply_command");
+    perf_scope_t perf_scope(PERF_TURN_TIME);
     if (_initialized == false) {
         warp_log_e("Cannot apply command, state not spawned.");
         return false;
@@ -335,20 +331,13 @@ bool level_state_t::apply_command(const command_t *cmd) {
     return true;
 }
 
-void level_state_t::process_real_time_event(const rt_event_t &event) {
-    if (_initialized == false) {
-        warp_log_e("Cannot process real time event, state not spawned.");
-        return;
-    }
-
-    if (event.type == RT_EVENT_BULETT_HIT) {
-        const vec3_t target_pos = event.value.get_vec3();
-        obj_id_t object = object_at_position(target_pos);
-        handle_attack(object, OBJ_ID_INVALID);
-    }
+void level_state_t::collect_resources(bool wait) {
+    if (_object_factory == NULL) return;
+    _object_factory->collect_resources(_world->get_resources(), wait);
 }
 
 void level_state_t::clear() {
+    TRACE_SCOPE("level_state_t::clear");
     if (_initialized == false) {
         warp_log_e("Cannot clear, already cleared.");
         return;
@@ -361,7 +350,7 @@ void level_state_t::clear() {
     _world->find_all_entities(WARP_TAG("bullet"), &buffer);
     for (size_t i = 0; i < warp_array_get_size(&buffer); i++) {
         entity_t *e = warp_array_get_value(entity_t *, &buffer, i);
-        _world->destroy_later(e);
+        destroy_game_entity(_world, e);
     }
     warp_array_destroy(&buffer);
 
@@ -622,16 +611,54 @@ void level_state_t::handle_shooting(obj_id_t shooter, warp_dir_t dir) {
 
     change_direction(obj, dir);
 
-    const float speed = 4.5f;
+    size_t distance = 0;
+    const obj_id_t target = find_arrow_target(obj->position, dir, &distance);
 
+    /* arrow flies from the edge of the shooter tile to the edge of the hit one */
     const vec3_t d = dir_to_vec3(dir);
     const vec3_t pos = vec3_add(obj->position, vec3_scale(d, 0.5f));
-    const vec3_t v = vec3_add(vec3_scale(d, speed), vec3(0.001f, 0, 0.001f));
-    _bullet_factory->create_bullet(pos, v, BULLET_ARROW, _level);
+    const float flight = distance > 0 ? distance - 1.0f : 0.0f;
+    _bullet_factory->create_bullet(pos, d, flight, BULLET_ARROW);
 
     const vec3_t recoil = vec3_add(obj->position, vec3_scale(d, -1));
     obj->entity->receive_message(CORE_DO_BOUNCE, recoil);
     obj->ammo -= 1;
+
+    if (target != OBJ_ID_INVALID) {
+        handle_attack(target, OBJ_ID_INVALID);
+    }
+}
+
+/* Arrows fly straight over walkable tiles, until they hit an object or
+ * stop at a wall, closed door or the level edge. Distance counts tiles
+ * up to and including the one where the arrow stops. */
+obj_id_t level_state_t::find_arrow_target
+        (vec3_t origin, dir_t dir, size_t *distance) const {
+    const vec3_t d = dir_to_vec3(dir);
+    const int dx = round(d.x);
+    const int dz = round(d.z);
+    *distance = 0;
+    if (dx == 0 && dz == 0) return OBJ_ID_INVALID;
+
+    int x = round(origin.x);
+    int z = round(origin.z);
+    while (true) {
+        x += dx;
+        z += dz;
+        *distance += 1;
+
+        /* checked here, get_tile_at reports tiles outside of the level */
+        if (x < 0 || z < 0 || (size_t)x >= _width || (size_t)z >= _height) break;
+
+        const tile_t *tile = _level->get_tile_at(x, z);
+        if (tile == NULL || tile->is_walkable == false) break;
+
+        const obj_id_t object = object_at(x, z);
+        if (object != OBJ_ID_INVALID) return object;
+
+        if (is_blocked_by_feature(x, z)) break;
+    }
+    return OBJ_ID_INVALID;
 }
 
 void level_state_t::change_button_state(feat_id_t button, feat_state_t state) {
@@ -104,15 +104,6 @@ struct event_t {
     event_type_t type;
 };
 
-enum rt_event_type_t : int {
-    RT_EVENT_BULETT_HIT = 1,
-};
-
-struct rt_event_t {
-    rt_event_type_t type;
-    warp::dynval_t value;
-};
-
 class bullet_factory_t;
 class object_factory_t;
 
@@ -142,6 +133,7 @@ class level_state_t {
 
 
         bool can_move_to(warp_vec3_t new_pos) const;
+        bool is_blocked_by_feature(size_t x, size_t z) const;
         bool is_object_idle(obj_id_t obj) const;
         bool has_object_flag(obj_id_t obj, object_flags_t flag) const;
         bool has_object_type(obj_id_t obj, object_type_t type) const;
@@ -152,8 +144,10 @@ class level_state_t {
         /* global state changes: */
         void spawn(const level_t *level, warp_random_t *rand);
         bool apply_command(const command_t *cmd);
-        void process_real_time_event(const rt_event_t &event);
         void clear();
+        /* adds resources preloaded by the object factory, with wait set
+         * blocks until all of them are ready: */
+        void collect_resources(bool wait);
 
         const std::vector<event_t> &get_last_turn_events() const {
             return _events;
@@ -173,6 +167,8 @@ class level_state_t {
         void handle_interaction(obj_id_t terminal, obj_id_t character);
         void handle_attack(obj_id_t target, obj_id_t attacker);
         void handle_shooting(obj_id_t shooter, warp_dir_t dir);
+        obj_id_t find_arrow_target
+            (warp_vec3_t origin, warp_dir_t dir, size_t *distance) const;
 
         void change_button_state(feat_id_t feat, feat_state_t state);
 
@@ -13,6 +13,7 @@
 #include "text-label.h"
 #include "transition_effect.h"
 #include "button.h"
+#include "message_bus.h"
 
 using namespace warp;
 
@@ -49,7 +50,9 @@ static void setup_light(renderer_t *renderer, region_lighting_t *light) {
 }
 
 bool level_transition_t::is_entity_kept(const entity_t *entity) const {
-    return warp_tag_equals_buffer(&entity->get_tag(), "persistent_data");
+    const warp_tag_t &tag = entity->get_tag();
+    return warp_tag_equals_buffer(&tag, "persistent_data")
+        || warp_tag_equals_buffer(&tag, "message_bus");
 }
 
 void level_transition_t::initialize_state(const warp_tag_t &, world_t *world) {
@@ -65,7 +68,7 @@ void level_transition_t::initialize_state(const warp_tag_t &, world_t *world) {
     }
 
     entity_t *ammo = create_label(world, font, flags);
-    if (ammo == NULL) {
+    if (ammo != NULL) {
         ammo->set_tag(WARP_TAG("ammo_label"));
         const vec3_t pos = ammo->get_position();
         ammo->receive_message(MSG_PHYSICS_MOVE, vec3_add(pos, vec3(0, -48, 0)));
@@ -80,13 +83,16 @@ void level_transition_t::initialize_state(const warp_tag_t &, world_t *world) {
         diag->receive_message(MSG_GRAPHICS_VISIBLITY, 0);
     }
 
+    create_button_hub(world);
+
+    message_bus_t *bus = get_message_bus(world);
     std::function<void(void)> restart_handler = [=]() {
-        world->broadcast_message(CORE_RESTART_LEVEL, 0);
+        bus->publish(CORE_RESTART_LEVEL, 0);
     };
     create_button(world, vec2(410, 280), vec2(60, 60), restart_handler, "reset-button.png");
 
     std::function<void(void)> reset_handler = [=]() {
-        world->broadcast_message(CORE_SAVE_RESET_DEFAULTS, 0);
+        bus->publish(CORE_SAVE_RESET_DEFAULTS, 0);
     };
     create_button(world, vec2(410, 200), vec2(60, 60), reset_handler, "reset-button.png");
 
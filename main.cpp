@@ -11,6 +11,7 @@
 #include "level_transition.h"
 #include "chat.h"
 #include "version.h"
+#include "save_writer.h"
 
 using namespace warp;
 
@@ -73,6 +74,7 @@ static int initialize_and_run() {
     }
 
     const int exit_code = game->run();
+    flush_saves();
     /* on iOS the game continues to operate after main has finished */
     if (game->is_alive_after_main() == false) {
         delete game;
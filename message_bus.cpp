@@ -0,0 +1,93 @@
+#define WARP_DROP_PREFIX
+#include "message_bus.h"
+
+#include "warp/world.h"
+#include "warp/entity.h"
+#include "warp/components.h"
+
+#include "entities.h"
+#include "perf.h"
+
+using namespace warp;
+
+static size_t get_type_index(core_msgs_t type) {
+    return (size_t)type - (size_t)CORE_TRY_MOVE;
+}
+
+void message_bus_t::subscribe(core_msgs_t type, entity_t *entity) {
+    const size_t index = get_type_index(type);
+    if (index >= TYPES_COUNT) {
+        warp_log_e("Cannot subscribe to message type %u.", (unsigned)type);
+        return;
+    }
+    std::vector<entity_t *> &subscribers = _subscribers[index];
+    for (entity_t *subscriber : subscribers) {
+        if (subscriber == entity) return;
+    }
+    subscribers.push_back(entity);
+}
+
+void message_bus_t::unsubscribe(core_msgs_t type, entity_t *entity) {
+    const size_t index = get_type_index(type);
+    if (index >= TYPES_COUNT) return;
+
+    std::vector<entity_t *> &subscribers = _subscribers[index];
+    for (auto it = subscribers.begin(); it != subscribers.end();) {
+        it = *it == entity ? subscribers.erase(it) : it + 1;
+    }
+}
+
+void message_bus_t::unsubscribe_all(entity_t *entity) {
+    for (size_t i = 0; i < TYPES_COUNT; i++) {
+        unsubscribe((core_msgs_t)(CORE_TRY_MOVE + i), entity);
+    }
+}
+
+void message_bus_t::publish(core_msgs_t type, const dynval_t &data) {
+    const size_t index = get_type_index(type);
+    if (index >= TYPES_COUNT) {
+        warp_log_e("Cannot publish message type %u.", (unsigned)type);
+        return;
+    }
+
+    PERF_ADD(PERF_BROADCASTS, 1);
+    /* handlers may subscribe or unsubscribe, so no iterators here */
+    const std::vector<entity_t *> &subscribers = _subscribers[index];
+    for (size_t i = 0; i < subscribers.size(); i++) {
+        PERF_ADD(PERF_BUS_DELIVERIES, 1);
+        subscribers[i]->receive_message(type, data);
+    }
+}
+
+class message_bus_controller_t final : public controller_impl_i {
+    public:
+        message_bus_controller_t()
+            : _bus(std::make_shared<message_bus_t>())
+        {}
+
+        dynval_t get_property(const warp_tag_t &name) const override {
+            if (warp_tag_equals_buffer(&name, "bus")) {
+                return (void *)_bus.get();
+            }
+            return dynval_t::make_null();
+        }
+
+        void initialize(entity_t *, world_t *) override { }
+        void update(float, const input_t &) override { }
+        void handle_message(const message_t &) override { }
+
+    private:
+        std::shared_ptr<message_bus_t> _bus;
+};
+
+extern message_bus_t *get_message_bus(world_t *world) {
+    entity_t *entity = world->find_entity(WARP_TAG("message_bus"));
+    if (entity == nullptr) {
+        controller_comp_t *controller = world->create_controller();
+        controller->initialize(new message_bus_controller_t);
+
+        entity = create_game_entity(world, vec3(0, 0, 0), NULL, NULL, controller);
+        entity->set_tag(WARP_TAG("message_bus"));
+    }
+    return (message_bus_t *)entity->get_property(WARP_TAG("bus")).get_pointer();
+}
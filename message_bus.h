@@ -0,0 +1,28 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "core.h"
+
+/* World broadcasts visit every entity of the world, even though only a
+ * few handle any given core message. The bus delivers a message only to
+ * entities subscribed to its type. Subscribers must unsubscribe before
+ * they are destroyed, they are kept as plain pointers. */
+class message_bus_t final : public std::enable_shared_from_this<message_bus_t> {
+    public:
+        void subscribe(core_msgs_t type, warp::entity_t *entity);
+        void unsubscribe(core_msgs_t type, warp::entity_t *entity);
+        void unsubscribe_all(warp::entity_t *entity);
+
+        /* delivers immediately, in the order of subscription */
+        void publish(core_msgs_t type, const warp::dynval_t &data);
+
+    private:
+        static const size_t TYPES_COUNT = CORE_MSGS_END - CORE_TRY_MOVE;
+        std::vector<warp::entity_t *> _subscribers[TYPES_COUNT];
+};
+
+/* The bus is kept between states, so pointers to it stay valid as long
+ * as the world. Created on first use: */
+message_bus_t *get_message_bus(warp::world_t *world);
@@ -11,6 +11,7 @@
 
 #include "level_state.h"
 #include "character.h"
+#include "entities.h"
 
 using namespace warp;
 
@@ -53,7 +54,7 @@ static void destroy_element(void *raw) {
     free(def);
 }
 
-object_factory_t::object_factory_t() {
+object_factory_t::object_factory_t() : _chats() {
     _objects = warp_map_create_typed(object_def_t, destroy_element);
 }
 
@@ -208,9 +209,14 @@ void object_factory_t::load_resources(resources_t *res) {
         const char *tex  = warp_str_value(&def->texture_name); 
         resources_load(res, mesh);
         resources_load(res, tex);
+        _chats.request(warp_str_value(&def->chat_script));
     }
 }
 
+void object_factory_t::collect_resources(resources_t *res, bool wait) {
+    _chats.collect(res, wait);
+}
+
 static dir_t random_direction(warp_random_t *rand) {
     const dir_t directions[4] {
         DIR_X_PLUS, DIR_Z_PLUS, DIR_X_MINUS, DIR_Z_MINUS,
@@ -274,25 +280,8 @@ static graphics_comp_t *create_graphics
 
 static controller_comp_t *create_controller
         (world_t *world, const object_t *obj, obj_id_t id) {
-    const bool confirm_moves = (obj->flags & FOBJ_PLAYER_AVATAR) != 0;
-    return create_character_controller(world, id, confirm_moves);
-}
-
-static physics_comp_t *create_physics(world_t *world, const object_t *obj) {
-    /* TODO: this should be put in definition: */
-    vec2_t size = vec2(0.4f, 0.4f);
-    if (obj->type == OBJ_BOULDER) {
-        size = vec2(0.6f, 0.6f);
-    }
-    
-    physics_comp_t *physics = world->create_physics();
-    if (physics != nullptr) {
-        physics->_flags = PHYSFLAGS_FIXED;
-        physics->_velocity = vec3(0, 0, 0);
-        aabb_init(&physics->_bounds, vec3(0, 0, 0), vec3(size.x, 1, size.y));
-    }
-
-    return physics;
+    const bool is_player = (obj->flags & FOBJ_PLAYER_AVATAR) != 0;
+    return create_character_controller(world, id, is_player);
 }
 
 static entity_t *create_entity
@@ -300,11 +289,10 @@ static entity_t *create_entity
         , const object_t *obj, obj_id_t id
         ) {
     graphics_comp_t *graphics = create_graphics(world, def);
-    physics_comp_t *physics = create_physics(world, obj);
     controller_comp_t *controller = create_controller(world, obj, id);
 
     entity_t *entity
-        = world->create_entity(obj->position, graphics, physics, controller);
+        = create_game_entity(world, obj->position, graphics, NULL, controller);
     entity->set_tag(WARP_TAG(def->is_player ? "player" : "object"));
     return entity;
 }
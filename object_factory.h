@@ -8,6 +8,7 @@
 #include "warp/resources/resources.h"
 
 #include "level_state.h"
+#include "chat_preloader.h"
 
 struct object_def_t;
 struct object_t;
@@ -22,6 +23,8 @@ class object_factory_t {
         object_factory_t();
         bool load_definitions(const char *filename);
         void load_resources(warp_resources_t *res);
+        /// Adds resources preloaded in the background, see chat_preloader_t.
+        void collect_resources(warp_resources_t *res, bool wait);
 
         warp::entity_t *create_object_entity
             ( const object_t *obj, obj_id_t id
@@ -39,4 +42,5 @@ class object_factory_t {
 
     private:
         warp_map_t _objects;
+        chat_preloader_t _chats;
 };
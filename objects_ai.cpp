@@ -6,6 +6,7 @@
 #include "warp/utils/directions.h"
 
 #include "core.h"
+#include "perf.h"
 
 using namespace warp;
 
@@ -237,6 +238,7 @@ extern bool pick_next_command
         ( command_t *command, obj_id_t id, ai_state_t *ai_state
         , const level_state_t* st, warp_random_t *rand
         ) {
+    perf_scope_t perf_scope(PERF_AI_TIME);
     if (command == NULL) {
         warp_log_e("Cannot fill null command.");
         return false;
@@ -0,0 +1,168 @@
+#define WARP_DROP_PREFIX
+#include "perf.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__APPLE__)
+#include <malloc/malloc.h>
+#elif defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+bool perf_overlay_enabled = false;
+
+static const size_t HISTORY_SIZE = 120;
+static const size_t HISTOGRAM_BUCKETS = 10;
+
+enum perf_kind_t {
+    PERF_KIND_FRAME,  /* sampled every frame */
+    PERF_KIND_EVENT,  /* only frames with non zero sample count */
+    PERF_KIND_RATE,   /* shown per second */
+    PERF_KIND_GAUGE,  /* only the latest sample is shown */
+};
+
+struct perf_metric_info_t {
+    const char *name;
+    perf_kind_t kind;
+};
+
+static const perf_metric_info_t METRICS[PERF_METRICS_COUNT] = {
+    { "frame ms",     PERF_KIND_FRAME },
+    { "turn ms",      PERF_KIND_EVENT },
+    { "ai ms",        PERF_KIND_EVENT },
+    { "region ms",    PERF_KIND_EVENT },
+    { "tessellated",  PERF_KIND_FRAME },
+    { "created/s",    PERF_KIND_RATE  },
+    { "destroyed/s",  PERF_KIND_RATE  },
+    { "broadcasts",   PERF_KIND_FRAME },
+    { "delivered",    PERF_KIND_FRAME },
+    { "updates",      PERF_KIND_FRAME },
+    { "asleep",       PERF_KIND_FRAME },
+    { "tweens",       PERF_KIND_FRAME },
+    { "heap kb",      PERF_KIND_GAUGE },
+};
+
+static double current[PERF_METRICS_COUNT];
+static double history[PERF_METRICS_COUNT][HISTORY_SIZE];
+static float frame_times[HISTORY_SIZE];
+static size_t history_next = 0;
+static size_t history_count = 0;
+
+static double get_heap_bytes() {
+#if defined(__APPLE__)
+    malloc_statistics_t stats;
+    malloc_zone_statistics(NULL, &stats);
+    return (double)stats.size_in_use;
+#elif defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    return (double)mallinfo2().uordblks;
+#else
+    return 0;
+#endif
+}
+
+extern void perf_enable(bool enable) {
+    if (enable && perf_overlay_enabled == false) {
+        memset(current, 0, sizeof current);
+        history_next = 0;
+        history_count = 0;
+    }
+    perf_overlay_enabled = enable;
+}
+
+extern void perf_add(perf_metric_t metric, double value) {
+    current[metric] += value;
+}
+
+extern void perf_end_frame(float dt) {
+    if (perf_overlay_enabled == false) return;
+
+    current[PERF_FRAME_TIME] = dt * 1000.0;
+    current[PERF_HEAP_BYTES] = get_heap_bytes() / 1024.0;
+
+    for (size_t i = 0; i < PERF_METRICS_COUNT; i++) {
+        history[i][history_next] = current[i];
+        current[i] = 0;
+    }
+    frame_times[history_next] = dt;
+
+    history_next = (history_next + 1) % HISTORY_SIZE;
+    if (history_count < HISTORY_SIZE) {
+        history_count += 1;
+    }
+}
+
+static bool is_sample_counted(perf_kind_t kind, double sample) {
+    return kind != PERF_KIND_EVENT || sample > 0;
+}
+
+/* digits give height of each bucket relative to the tallest one */
+static void format_histogram
+        (char *output, const double *samples, perf_kind_t kind, double max) {
+    size_t buckets[HISTOGRAM_BUCKETS] = { 0 };
+    size_t tallest = 0;
+    for (size_t i = 0; i < history_count; i++) {
+        if (is_sample_counted(kind, samples[i]) == false) continue;
+
+        size_t bucket = max > 0 ? (size_t)(samples[i] / max * HISTOGRAM_BUCKETS) : 0;
+        if (bucket >= HISTOGRAM_BUCKETS) {
+            bucket = HISTOGRAM_BUCKETS - 1;
+        }
+        buckets[bucket] += 1;
+        if (buckets[bucket] > tallest) {
+            tallest = buckets[bucket];
+        }
+    }
+
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        output[i] = tallest == 0 ? '0' : (char)('0' + buckets[i] * 9 / tallest);
+    }
+    output[HISTOGRAM_BUCKETS] = '\0';
+}
+
+extern void perf_format(char *buffer, size_t size) {
+    if (size == 0) return;
+    buffer[0] = '\0';
+
+    double total_time = 0;
+    for (size_t i = 0; i < history_count; i++) {
+        total_time += frame_times[i];
+    }
+
+    size_t written = 0;
+    for (size_t m = 0; m < PERF_METRICS_COUNT && written < size; m++) {
+        const perf_kind_t kind = METRICS[m].kind;
+        const double *samples = history[m];
+
+        double sum = 0;
+        double max = 0;
+        size_t count = 0;
+        for (size_t i = 0; i < history_count; i++) {
+            if (is_sample_counted(kind, samples[i]) == false) continue;
+            sum += samples[i];
+            max = samples[i] > max ? samples[i] : max;
+            count += 1;
+        }
+
+        int length = 0;
+        if (kind == PERF_KIND_GAUGE) {
+            const size_t last = (history_next + HISTORY_SIZE - 1) % HISTORY_SIZE;
+            const double value = history_count > 0 ? samples[last] : 0;
+            length = snprintf
+                (buffer + written, size - written, "%s: %.0f\n", METRICS[m].name, value);
+        } else if (kind == PERF_KIND_RATE) {
+            const double rate = total_time > 0 ? sum / total_time : 0;
+            length = snprintf
+                (buffer + written, size - written, "%s: %.1f\n", METRICS[m].name, rate);
+        } else {
+            char histogram[HISTOGRAM_BUCKETS + 1];
+            format_histogram(histogram, samples, kind, max);
+            length = snprintf
+                ( buffer + written, size - written, "%s: avg %.2f max %.2f %s\n"
+                , METRICS[m].name, count > 0 ? sum / count : 0, max, histogram
+                );
+        }
+        if (length < 0) break;
+        written += length;
+    }
+}
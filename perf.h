@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stddef.h>
+#include <chrono>
+
+/// Metrics shown by the performance overlay, times are in milliseconds.
+enum perf_metric_t : int {
+    PERF_FRAME_TIME,
+    PERF_TURN_TIME,
+    PERF_AI_TIME,
+    PERF_REGION_LOAD_TIME,
+    PERF_TESSELLATIONS,
+    PERF_ENTITIES_CREATED,
+    PERF_ENTITIES_DESTROYED,
+    PERF_BROADCASTS,     /* published core messages, each used to visit every entity */
+    PERF_BUS_DELIVERIES, /* subscribers visited by those messages */
+    PERF_CONTROLLER_UPDATES,
+    PERF_CONTROLLERS_ASLEEP,
+    PERF_TWEENS,
+    PERF_HEAP_BYTES,
+
+    PERF_METRICS_COUNT,
+};
+
+/// Checked inline by instrumentation, so a disabled overlay costs a branch.
+extern bool perf_overlay_enabled;
+
+void perf_enable(bool enable);
+/// Adds value to the metric sample of the current frame.
+void perf_add(perf_metric_t metric, double value);
+/// Closes the current frame, its samples go to the rolling histograms.
+void perf_end_frame(float dt);
+/// Writes the overlay text, one line per metric.
+void perf_format(char *buffer, size_t size);
+
+#define PERF_ADD(metric, value) \
+    do { if (perf_overlay_enabled) perf_add((metric), (value)); } while (0)
+
+/// Adds time spent in the enclosing scope to metric.
+class perf_scope_t {
+    public:
+        explicit perf_scope_t(perf_metric_t metric)
+            : _metric(metric)
+            , _running(perf_overlay_enabled) {
+            if (_running) {
+                _start = std::chrono::steady_clock::now();
+            }
+        }
+
+        ~perf_scope_t() {
+            if (_running) {
+                const auto end = std::chrono::steady_clock::now();
+                perf_add(_metric, std::chrono::duration<double, std::milli>(end - _start).count());
+            }
+        }
+
+        perf_scope_t(const perf_scope_t &) = delete;
+        perf_scope_t &operator=(const perf_scope_t &) = delete;
+
+    private:
+        perf_metric_t _metric;
+        bool _running;
+        std::chrono::steady_clock::time_point _start;
+};
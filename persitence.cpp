@@ -6,18 +6,30 @@
 #include "warp/components.h"
 #include "warp/utils/io.h"
 
+#include <chrono>
+#include <vector>
+
 #include "libs/parson/parson.h"
 
 #include "region.h"
 #include "level_state.h"
 #include "version.h"
+#include "save_writer.h"
+#include "save_format.h"
+#include "facts.h"
+#include "message_bus.h"
+#include "entities.h"
+#include "trace.h"
 
 using namespace warp;
 
-static const char *SAVE_FILENAME = "save.json";
+static const char *SAVE_FILENAME = "save.bin";
+static const char *JOURNAL_FILENAME = "save.journal";
+static const char *LEGACY_SAVE_FILENAME = "save.json"; /* imported if no binary save */
+static const size_t JOURNAL_COMPACTION_SIZE = 64 * 1024;
 static const uint32_t DEFAULT_SEED = 314;
 
-static bool get_save_path(warp_str_t *out_path) {
+static bool get_save_path(const char *filename, warp_str_t *out_path) {
     bool result = true;
     const char *dir_path = NULL;
     warp_str_t directory; 
@@ -26,11 +38,12 @@ static bool get_save_path(warp_str_t *out_path) {
     if (WARP_FAILED(get_result)) {
         warp_result_log("Cannot get directory for game save", &get_result);
         warp_result_destory(&get_result);
+        result = false;
         goto cleanup;
     }
 
     dir_path = warp_str_value(&directory);
-    *out_path = warp_str_format("%s/%s-%s", dir_path, PROJECT_NAME, SAVE_FILENAME);
+    *out_path = warp_str_format("%s/%s-%s", dir_path, PROJECT_NAME, filename);
 
 cleanup:
     warp_str_destroy(&directory);
@@ -42,13 +55,24 @@ class persistence_controller_t final : public controller_impl_i {
     public:
         persistence_controller_t()
                 : _owner(NULL)
-                , _world(NULL) {
-            _facts = warp_map_create_typed(int, NULL);
+                , _world(NULL)
+                , _save_path()
+                , _journal_path()
+                , _journal()
+                , _journal_size(0)
+                , _needs_compaction(false)
+                , _names(fact_get_shared_names()) {
+            fact_set_init(&_facts);
         }
 
         ~persistence_controller_t() {
+            if (_bus != nullptr) {
+                _bus->unsubscribe_all(_owner);
+            }
+            warp_str_destroy(&_save_path);
+            warp_str_destroy(&_journal_path);
             warp_str_destroy(&_portal.region_name);
-            warp_map_destroy(&_facts);
+            fact_set_destroy(&_facts);
         }
 
         dynval_t get_property(const warp_tag_t &name) const override {
@@ -87,14 +111,19 @@ class persistence_controller_t final : public controller_impl_i {
             _seed = DEFAULT_SEED;
 
             /* default fact set */
-            warp_map_destroy(&_facts);
-            _facts = warp_map_create_typed(int, NULL);
+            fact_set_clear(&_facts);
         }
 
         void initialize(entity_t *owner, world_t *world) override {
             _owner = owner;
             _world = world;
 
+            _bus = get_message_bus(_world)->shared_from_this();
+            _bus->subscribe(CORE_SAVE_RESET_DEFAULTS, _owner);
+            _bus->subscribe(CORE_SAVE_TO_FILE, _owner);
+
+            get_save_path(SAVE_FILENAME, &_save_path);
+            get_save_path(JOURNAL_FILENAME, &_journal_path);
             set_defaults();
 
             read_data();
@@ -113,6 +142,7 @@ class persistence_controller_t final : public controller_impl_i {
                 const object_t *player = (object_t *) value;
                 _player = *player;
                 _player.entity = nullptr;
+                write_journal_player(&_journal, &_player);
             } else if (type == CORE_SAVE_PORTAL) {
                 void * value = message.data.get_pointer();
                 if (value == NULL) {
@@ -123,28 +153,60 @@ class persistence_controller_t final : public controller_impl_i {
                 warp_str_destroy(&_portal.region_name);
                 _portal = *portal;
                 _portal.region_name = warp_str_copy(&portal->region_name);
+                write_journal_portal(&_journal, &_portal);
             } else if (type == CORE_SAVE_SEED) {
                 const int packed_seed = message.data.get_int();
                 _seed = *(uint32_t *)&packed_seed;
+                write_journal_seed(&_journal, _seed);
             } else if (type == CORE_SAVE_FACTS) {
-                const warp_map_t *facts
-                        = (const warp_map_t *)message.data.get_pointer();
-                warp_map_copy_entries(&_facts, facts);
+                const fact_set_t *facts
+                        = (const fact_set_t *)message.data.get_pointer();
+                save_changed_facts(facts);
             } else if (type == CORE_SAVE_RESET_DEFAULTS) {
                 set_defaults();
+                /* journal would be replayed over the defaults */
+                _journal.clear();
+                _needs_compaction = true;
             } else if (type == CORE_SAVE_TO_FILE) {
                 save_data();
             }
         }
 
     private:
+        friend void benchmark_save_format(size_t facts_count);
+
         entity_t *_owner;
         world_t *_world;
+        std::shared_ptr<message_bus_t> _bus;
 
         portal_t   _portal;
         object_t   _player;
         uint32_t   _seed;
-        warp_map_t _facts;
+        fact_set_t _facts;
+
+        warp_str_t _save_path;
+        warp_str_t _journal_path;
+
+        std::vector<char> _journal; /* records not submitted yet */
+        size_t _journal_size;       /* bytes in the journal file */
+        bool _needs_compaction;
+        fact_names_t *_names; /* the shared table, except in benchmarks */
+
+        /* only facts that differ from the saved ones go to the journal */
+        void save_changed_facts(const fact_set_t *facts) {
+            for (size_t i = 0; i < facts->count; i++) {
+                const int value = facts->values[i];
+                if (value != fact_set_get(&_facts, i)) {
+                    write_journal_fact(&_journal, fact_names_get(_names, i), value);
+                }
+            }
+            for (size_t i = facts->count; i < _facts.count; i++) {
+                if (_facts.values[i] != 0) {
+                    write_journal_fact(&_journal, fact_names_get(_names, i), 0);
+                }
+            }
+            fact_set_copy(&_facts, facts);
+        }
 
         JSON_Value *save_portal() {
             JSON_Value *portal_value = json_value_init_object();
@@ -241,11 +303,11 @@ class persistence_controller_t final : public controller_impl_i {
             for (size_t i = 0; i < count; i++) {
                 const char *fact = json_object_get_name(facts, i);
                 const int value  = json_object_get_number(facts, fact);
-                warp_map_insert(&_facts, fact, &value);
+                fact_set_set(&_facts, fact_names_intern(_names, fact), value);
             }
         }
 
-        void save_data() {
+        JSON_Value *save_json() {
             JSON_Value *root_value = json_value_init_object();
             JSON_Object *root_object = json_value_get_object(root_value);
 
@@ -255,53 +317,218 @@ class persistence_controller_t final : public controller_impl_i {
 
             JSON_Value *facts_value = json_value_init_object();
             JSON_Object *facts_object = json_value_get_object(facts_value);
-            warp_map_it_t *it = warp_map_iterate(&_facts);
-            for (; it != NULL; it = warp_map_it_next(it, &_facts)) {
-                const char *key = warp_map_it_get_key(it);
-                int *value = (int *) warp_map_it_get_value(it);
-
-                json_object_set_number(facts_object, key, *value);
-                warp_log_d("[%s] -> %d", key, *value);
+            for (size_t i = 0; i < _facts.count; i++) {
+                const int value = _facts.values[i];
+                if (value != 0) {
+                    json_object_set_number(facts_object, fact_names_get(_names, i), value);
+                }
             }
             json_object_set_value(root_object, "facts", facts_value);
 
-            char *serialized = json_serialize_to_string_pretty(root_value);
-            const size_t size = strnlen(serialized, 4096);
-            
-            warp_str_t save_path;
-            get_save_path(&save_path);
-            const char *path = warp_str_value(&save_path);
-
-            warp_result_t save_result = save_file(path, serialized, size);
-            if (WARP_FAILED(save_result)) {
-                warp_result_log("Failed to save game", &save_result);
-                warp_result_destory(&save_result);
+            return root_value;
+        }
+
+        void read_json(const JSON_Object *root) {
+            read_portal(json_object_get_object(root, "portal"));
+            read_player(json_object_get_object(root, "player"));
+            read_facts(json_object_get_object(root, "facts"));
+            _seed = json_object_get_number(root, "seed");
+        }
+
+        void append_journal() {
+            if (_journal.empty()) return;
+
+            std::vector<char> buffer;
+            if (_journal_size == 0) {
+                write_journal_header(&buffer);
             }
+            buffer.insert(buffer.end(), _journal.begin(), _journal.end());
+            _journal.clear();
 
-            json_free_serialized_string(serialized);
-            json_value_free(root_value);
-            warp_str_destroy(&save_path);
+            submit_save_append(warp_str_value(&_journal_path), buffer.data(), buffer.size());
+            _journal_size += buffer.size();
         }
 
-        void read_data() {
-            warp_str_t save_path;
-            get_save_path(&save_path);
-            const char *path = warp_str_value(&save_path);
+        /* replaces the save with current state and starts an empty journal,
+         * both are written on the writer thread in submission order */
+        void compact() {
+            std::vector<char> buffer;
+            write_binary_save(&buffer, &_portal, &_player, _seed, &_facts, _names);
+            submit_save(warp_str_value(&_save_path), buffer.data(), buffer.size());
+
+            buffer.clear();
+            write_journal_header(&buffer);
+            submit_save(warp_str_value(&_journal_path), buffer.data(), buffer.size());
+
+            _journal.clear();
+            _journal_size = buffer.size();
+            _needs_compaction = false;
+        }
+
+        void save_data() {
+            TRACE_SCOPE("save_data");
+            const auto start = std::chrono::steady_clock::now();
+
+            const size_t appended = _journal.size();
+            const bool compacting = _needs_compaction
+                || _journal_size + appended > JOURNAL_COMPACTION_SIZE;
+            if (compacting) {
+                compact();
+            } else {
+                append_journal();
+            }
+
+            const auto end = std::chrono::steady_clock::now();
+            const double time 
+                = std::chrono::duration<double, std::milli>(end - start).count();
+            const save_writer_stats_t stats = get_save_writer_stats();
+            warp_log_d( "Save %s %zu bytes in %.3f ms, journal has %zu bytes,"
+                        " last write took %.3f ms (max %.3f ms), %zu written,"
+                        " %zu coalesced, %zu failed."
+                      , compacting ? "compacted, journal had" : "appended"
+                      , appended, time, _journal_size, stats.last_write_ms
+                      , stats.max_write_ms, stats.written_count
+                      , stats.coalesced_count, stats.failed_count
+                      );
+        }
+
+        void read_portal_view(const save_view_t *view) {
+            warp_str_destroy(&_portal.region_name);
+            _portal.region_name = warp_str_create(view->region_name);
+            _portal.level_x = view->level_x;
+            _portal.level_z = view->level_z;
+            _portal.tile_x = view->tile_x;
+            _portal.tile_z = view->tile_z;
+        }
+
+        void read_player_view(const save_view_t *view) {
+            if (view->has_player == false) return;
+
+            _player.type = OBJ_CHARACTER;
+            _player.health = view->health;
+            _player.max_health = view->max_health;
+            _player.ammo = view->ammo;
+            _player.flags = (object_flags_t) view->flags;
+            _player.direction = (dir_t) view->direction;
+            _player.position 
+                = vec3(view->position[0], view->position[1], view->position[2]);
+        }
+
+        void read_view(const save_view_t *view) {
+            read_portal_view(view);
+            read_player_view(view);
+            _seed = view->seed;
+
+            for (size_t i = 0; i < view->facts_count; i++) {
+                const char *fact = NULL;
+                int value = 0;
+                if (get_save_view_fact(view, i, &fact, &value)) {
+                    fact_set_set(&_facts, fact_names_intern(_names, fact), value);
+                }
+            }
+        }
+
+        bool read_binary_data() {
+            const char *path = warp_str_value(&_save_path);
+            warp_array_t bytes = { NULL };
+            warp_result_t read_result = read_file(path, &bytes);
+            if (WARP_FAILED(read_result)) {
+                /* no binary save yet, not an error */
+                warp_result_destory(&read_result);
+                warp_array_destroy(&bytes);
+                return false;
+            }
+
+            const char *data = (const char *) warp_array_get(&bytes, 0);
+            const size_t size = warp_array_get_size(&bytes);
 
+            save_view_t view;
+            const bool success = read_binary_save(data, size, &view);
+            if (success) {
+                read_view(&view);
+            } else {
+                warp_log_e("Failed to read binary save: %s.", path);
+            }
+
+            warp_array_destroy(&bytes);
+            return success;
+        }
+
+        void read_json_data() {
+            warp_str_t legacy_path = { NULL };
+            if (get_save_path(LEGACY_SAVE_FILENAME, &legacy_path) == false) {
+                return;
+            }
+
+            const char *path = warp_str_value(&legacy_path);
             JSON_Value *root_value = json_parse_file(path);
             if (json_value_get_type(root_value) != JSONObject) {
                 warp_log_e("Failed to load JSON file: %s.", path);
+                json_value_free(root_value);
+                warp_str_destroy(&legacy_path);
                 return; 
             }
-            const JSON_Object *root = json_value_get_object(root_value);
-            
-            read_portal(json_object_get_object(root, "portal"));
-            read_player(json_object_get_object(root, "player"));
-            read_facts(json_object_get_object(root, "facts"));
-            _seed = json_object_get_number(root, "seed");
+            read_json(json_value_get_object(root_value));
 
             json_value_free(root_value);
-            warp_str_destroy(&save_path);
+            warp_str_destroy(&legacy_path);
+        }
+
+        void apply_journal_record(const journal_record_t *record) {
+            const save_view_t *view = &record->view;
+            if (record->kind == JOURNAL_FACT) {
+                fact_set_set(&_facts, fact_names_intern(_names, record->fact), record->value);
+            } else if (record->kind == JOURNAL_PLAYER) {
+                read_player_view(view);
+            } else if (record->kind == JOURNAL_PORTAL) {
+                read_portal_view(view);
+            } else if (record->kind == JOURNAL_SEED) {
+                _seed = view->seed;
+            }
+        }
+
+        void replay_journal() {
+            const char *path = warp_str_value(&_journal_path);
+            warp_array_t bytes = { NULL };
+            warp_result_t read_result = read_file(path, &bytes);
+            if (WARP_FAILED(read_result)) {
+                /* nothing was appended since the last compaction */
+                warp_result_destory(&read_result);
+                warp_array_destroy(&bytes);
+                _journal_size = 0;
+                return;
+            }
+
+            const char *data = (const char *) warp_array_get(&bytes, 0);
+            const size_t size = warp_array_get_size(&bytes);
+
+            size_t offset = 0;
+            size_t records_count = 0;
+            journal_record_t record;
+            while (read_journal_record(data, size, &offset, &record)) {
+                apply_journal_record(&record);
+                records_count += 1;
+            }
+
+            /* anything after a cut record would never be read again */
+            if (offset == 0 || (offset < size && data[offset] != '\0')) {
+                _needs_compaction = true;
+            }
+            _journal_size = offset;
+
+            warp_log_d("Replayed %zu records from save journal.", records_count);
+            warp_array_destroy(&bytes);
+        }
+
+        void read_data() {
+            /* previous controller may still have a save in flight */
+            flush_saves();
+
+            if (read_binary_data() == false) {
+                read_json_data();
+                _needs_compaction = true;
+            }
+            replay_journal();
         }
 };
 
@@ -317,7 +544,7 @@ extern entity_t *create_persitent_data(world_t *world) {
     controller_comp_t *ctrl = world->create_controller();
     ctrl->initialize(new persistence_controller_t);
 
-    entity_t *entity = world->create_entity(vec3(0, 0, 0), NULL, NULL, ctrl);
+    entity_t *entity = create_game_entity(world, vec3(0, 0, 0), NULL, NULL, ctrl);
     entity->set_tag(WARP_TAG("persistent_data"));
 
     return entity;
@@ -346,8 +573,8 @@ extern uint32_t get_saved_seed(world_t *world) {
     return *(uint32_t *)&packed_seed;
 }
 
-extern const warp_map_t *get_saved_facts(world_t *world) {
-    return (const warp_map_t *)get_saved_data(world, WARP_TAG("facts"));
+extern const fact_set_t *get_saved_facts(world_t *world) {
+    return (const fact_set_t *)get_saved_data(world, WARP_TAG("facts"));
 }
 
 extern void save_player_state(world_t *world, const object_t *player) {
@@ -366,7 +593,72 @@ extern void save_random_seed(world_t *world, uint32_t seed) {
     data->receive_message(CORE_SAVE_SEED, packed_seed);
 }
 
-extern void save_facts(world_t *world, const warp_map_t *facts) {
+extern void save_facts(world_t *world, const fact_set_t *facts) {
     entity_t *data = get_persitent_data(world);
     data->receive_message(CORE_SAVE_FACTS, (void *)facts);
 }
+
+static double elapsed_ms(std::chrono::steady_clock::time_point start) {
+    const auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+extern void benchmark_save_format(size_t facts_count) {
+    /* benchmark facts stay out of the table shared with the game */
+    fact_names_t *names = fact_names_create();
+
+    persistence_controller_t source;
+    source._names = names;
+    source.set_defaults();
+    source._player.type = OBJ_CHARACTER;
+    for (size_t i = 0; i < facts_count; i++) {
+        warp_str_t fact = warp_str_format("benchmark_fact_%zu", i);
+        const int value = (int)i + 1;
+        fact_set_set(&source._facts, fact_names_intern(names, warp_str_value(&fact)), value);
+        warp_str_destroy(&fact);
+    }
+
+    /* json, as saved before binary format, without the size cap */
+    auto start = std::chrono::steady_clock::now();
+    JSON_Value *root_value = source.save_json();
+    char *serialized = json_serialize_to_string_pretty(root_value);
+    const double json_save_time = elapsed_ms(start);
+    const size_t json_size = strlen(serialized);
+    json_value_free(root_value);
+
+    persistence_controller_t json_target;
+    json_target._names = names;
+    json_target.set_defaults();
+    start = std::chrono::steady_clock::now();
+    root_value = json_parse_string(serialized);
+    json_target.read_json(json_value_get_object(root_value));
+    const double json_load_time = elapsed_ms(start);
+    json_value_free(root_value);
+    json_free_serialized_string(serialized);
+
+    start = std::chrono::steady_clock::now();
+    std::vector<char> buffer;
+    write_binary_save
+        ( &buffer, &source._portal, &source._player, source._seed
+        , &source._facts, names
+        );
+    const double binary_save_time = elapsed_ms(start);
+
+    persistence_controller_t binary_target;
+    binary_target._names = names;
+    binary_target.set_defaults();
+    start = std::chrono::steady_clock::now();
+    save_view_t view;
+    if (read_binary_save(buffer.data(), buffer.size(), &view)) {
+        binary_target.read_view(&view);
+    }
+    const double binary_load_time = elapsed_ms(start);
+
+    warp_log_d( "Save with %zu facts: json %zu bytes, save %.3f ms, load %.3f ms;"
+                " binary %zu bytes, save %.3f ms, load %.3f ms."
+              , facts_count
+              , json_size, json_save_time, json_load_time
+              , buffer.size(), binary_save_time, binary_load_time
+              );
+    fact_names_destroy(names);
+}
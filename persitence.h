@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 
 namespace warp {
@@ -10,7 +11,7 @@ namespace warp {
 struct object_t;
 struct portal_t;
 
-typedef struct warp_map warp_map_t;
+typedef struct fact_set fact_set_t;
 
 warp::entity_t *get_persitent_data(warp::world_t *world);
 warp::entity_t *create_persitent_data(warp::world_t *world);
@@ -18,10 +19,14 @@ warp::entity_t *create_persitent_data(warp::world_t *world);
 const object_t *get_saved_player_state(warp::world_t *world);
 const portal_t *get_saved_portal(warp::world_t *world);
 uint32_t get_saved_seed(warp::world_t *world);
-const warp_map_t *get_saved_facts(warp::world_t *world);
+const fact_set_t *get_saved_facts(warp::world_t *world);
 
 void save_player_state(warp::world_t *world, const object_t *player);
 void save_portal(warp::world_t *world, const portal_t *portal);
 void save_random_seed(warp::world_t *world, uint32_t seed);
-void save_facts(warp::world_t *world, const warp_map_t *facts);
+/// Facts are copied whole, only the changed ones are written to the save.
+void save_facts(warp::world_t *world, const fact_set_t *facts);
 
+
+/// Compares save and load time and size of JSON and binary saves.
+void benchmark_save_format(size_t facts_count);
@@ -1,18 +1,31 @@
 #define WARP_DROP_PREFIX
 #include "region.h"
 
+#include <cstdio> /* sscanf */
+#include <cstdlib> /* malloc, free */
 #include <cstring> /* memmove */
 #include <map>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
 
 #include "warp/utils/io.h"
+#include "warp/collections/map.h"
 #include "warp/renderer.h"
 
 #include "libs/parson/parson.h"
 
 #include "level.h"
+#include "level_generator.h"
+#include "region_reader.h"
 
 using namespace warp;
 
+static const size_t MAX_ASSEMBLY_THREADS = 8;
+static const size_t PREFETCH_RADIUS = 2; /* levels generated ahead */
+static const size_t DROP_RADIUS = 3;     /* levels kept behind */
+
 static void destroy_portal(void *raw_portal) {
     portal_t *portal = (portal_t *)raw_portal;
     warp_str_destroy(&portal->region_name);
@@ -24,51 +37,313 @@ static void destroy_tile_graphics(void *raw_graphics) {
     warp_str_destroy(&graphics->texture);
 }
 
-region_t::region_t(level_t **levels, size_t width, size_t height)
+static double elapsed_ms(std::chrono::steady_clock::time_point start) {
+    const auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+static size_t get_assembly_threads_count(size_t levels_count) {
+    size_t count = std::thread::hardware_concurrency();
+    if (count > MAX_ASSEMBLY_THREADS) count = MAX_ASSEMBLY_THREADS;
+    if (count > levels_count) count = levels_count;
+    return count == 0 ? 1 : count;
+}
+
+/* Level meshes do not depend on each other, so they are assembled on worker
+ * threads (the calling thread included) taking levels one at a time. */
+static void assemble_meshes
+        ( level_t **levels, mesh_builder_t *builders, size_t count
+        , const region_t *owner, size_t threads_count
+        ) {
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        for (size_t i = next++; i < count; i = next++) {
+            levels[i]->assemble_mesh(builders + i, owner);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < threads_count; i++) {
+        threads.push_back(std::thread(worker));
+    }
+    worker();
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+}
+
+static void fill_default_lighting(region_lighting_t *lighting) {
+    light_settings_t defaults;
+    fill_default_light_settings(&defaults);
+    lighting->sun_color = defaults.sun_color;
+    lighting->sun_direction = defaults.sun_direction;
+    lighting->ambient_color = defaults.ambient_color;
+}
+
+static int get_offset(size_t coordinate, size_t origin) {
+    return (int)(ptrdiff_t)(coordinate - origin);
+}
+
+/* Chunks are keyed by the low 32 bits of coordinates, coordinates of
+ * unbounded regions that wrapped below zero are restored by sign extension. */
+static uint64_t get_chunk_key(size_t x, size_t z) {
+    const uint64_t chunk_x = (uint32_t)x / LEVEL_CHUNK_SIZE;
+    const uint64_t chunk_z = (uint32_t)z / LEVEL_CHUNK_SIZE;
+    return (chunk_x << 32) | chunk_z;
+}
+
+static size_t get_chunk_coordinate(uint32_t chunk, size_t offset) {
+    const uint32_t coordinate = chunk * LEVEL_CHUNK_SIZE + offset;
+    return (size_t)(ptrdiff_t)(int32_t)coordinate;
+}
+
+static size_t get_slot_index(size_t x, size_t z) {
+    return x % LEVEL_CHUNK_SIZE + LEVEL_CHUNK_SIZE * (z % LEVEL_CHUNK_SIZE);
+}
+
+/* level meshes count against the budget as well */
+static size_t get_resident_size(const level_t *level) {
+    return level->get_memory_size() + level->get_mesh_size();
+}
+
+static bool is_chunk_empty(const level_chunk_t *chunk) {
+    for (const level_slot_t &slot : chunk->slots) {
+        if (slot.level != NULL || slot.length > 0) return false;
+    }
+    return true;
+}
+
+region_t::region_t
+            ( level_t **levels, size_t width, size_t height
+            , tile_palette_t *palette
+            )
         : _initialized(false)
         , _width(width)
         , _height(height)
-        , _levels(nullptr)
+        , _procedural(false)
+        , _seed(0)
+        , _chunks()
+        , _palette(palette)
         , _portals() 
-        , _graphics() {
-    const size_t tiles_count = _width * _height;
-    _levels = new (std::nothrow) level_t * [tiles_count];
-    memmove(_levels, levels, tiles_count * sizeof (level_t *));
+        , _graphics()
+        , _world(nullptr)
+        , _generator(nullptr)
+        , _source(nullptr)
+        , _budget(0)
+        , _resident_bytes(0)
+        , _clock(0)
+        , _current_x(0)
+        , _current_z(0) {
+    for (size_t i = 0; i < _width; i++) {
+        for (size_t j = 0; j < _height; j++) {
+            level_t *level = levels[i + _width * j];
+            if (level != NULL) {
+                create_slot(i, j)->level = level;
+                _resident_bytes += level->get_memory_size();
+            }
+        }
+    }
 
     _graphics = warp_array_create_typed(tile_graphics_t, 16, destroy_tile_graphics);
     _portals  = warp_array_create_typed(portal_t, 16, destroy_portal);
     
-    light_settings_t defaults;
-    fill_default_light_settings(&defaults);
-    _lighting.sun_color = defaults.sun_color;
-    _lighting.sun_direction = defaults.sun_direction;
-    _lighting.ambient_color = defaults.ambient_color;
+    fill_default_lighting(&_lighting);
+}
+
+region_t::region_t(uint32_t seed)
+        : _initialized(false)
+        , _width(SIZE_MAX)
+        , _height(SIZE_MAX)
+        , _procedural(true)
+        , _seed(seed)
+        , _chunks()
+        , _palette(new tile_palette_t)
+        , _portals() 
+        , _graphics()
+        , _world(nullptr)
+        , _generator(nullptr)
+        , _source(nullptr)
+        , _budget(0)
+        , _resident_bytes(0)
+        , _clock(0)
+        , _current_x(0)
+        , _current_z(0) {
+    _graphics = warp_array_create_typed(tile_graphics_t, 16, destroy_tile_graphics);
+    _portals  = warp_array_create_typed(portal_t, 16, destroy_portal);
+
+    fill_default_lighting(&_lighting);
 }
 
 region_t::~region_t() {
-    const size_t tiles_count = _width * _height;
-    for (size_t i = 0; i < tiles_count; i++)
-        delete _levels[i];
-    delete [] _levels;
+    delete _generator;
+    for (auto &entry : _chunks) {
+        for (level_slot_t &slot : entry.second->slots) {
+            delete slot.level;
+        }
+        delete entry.second;
+    }
+    delete _palette;
+    destroy_region_source(_source);
+
     warp_array_destroy(&_graphics);
     warp_array_destroy(&_portals);
 }
 
+level_slot_t *region_t::find_slot(size_t x, size_t z) const {
+    auto found = _chunks.find(get_chunk_key(x, z));
+    if (found == _chunks.end()) {
+        return NULL;
+    }
+    return found->second->slots + get_slot_index(x, z);
+}
+
+level_slot_t *region_t::create_slot(size_t x, size_t z) {
+    level_chunk_t *&chunk = _chunks[get_chunk_key(x, z)];
+    if (chunk == NULL) {
+        chunk = new level_chunk_t;
+        memset(chunk, 0, sizeof *chunk);
+    }
+    return chunk->slots + get_slot_index(x, z);
+}
+
+void region_t::remove_slot(size_t x, size_t z) {
+    auto found = _chunks.find(get_chunk_key(x, z));
+    if (found == _chunks.end()) return;
+
+    level_chunk_t *chunk = found->second;
+    memset(chunk->slots + get_slot_index(x, z), 0, sizeof (level_slot_t));
+    if (is_chunk_empty(chunk)) {
+        delete chunk;
+        _chunks.erase(found);
+    }
+}
+
+size_t region_t::get_levels_count() const {
+    size_t count = 0;
+    for (const auto &entry : _chunks) {
+        for (const level_slot_t &slot : entry.second->slots) {
+            if (slot.level != NULL || slot.length > 0) count++;
+        }
+    }
+    return count;
+}
+
+void region_t::set_level_source
+        ( region_source_t *source, const level_location_t *locations
+        , size_t budget
+        ) {
+    if (_procedural || source == NULL || locations == NULL) {
+        warp_log_e("Cannot set source of region levels.");
+        destroy_region_source(source);
+        return;
+    }
+
+    destroy_region_source(_source);
+    _source = source;
+    _budget = budget;
+
+    for (size_t i = 0; i < _width; i++) {
+        for (size_t j = 0; j < _height; j++) {
+            const level_location_t *location = locations + (i + _width * j);
+            if (location->length == 0) continue;
+
+            level_slot_t *slot = create_slot(i, j);
+            slot->offset = location->offset;
+            slot->length = location->length;
+        }
+    }
+}
+
 void region_t::initialize(world_t *world) {
     if (world == NULL) { 
         warp_log_e("Cannot initialize region, world is null.");
         return;
     }
 
-    for (size_t i = 0; i < _width; i++) {
-        for (size_t j = 0; j < _height; j++) {
-            level_t *level = _levels[i + _width * j];
-            if (level->is_initialized() == false) {
-                level->initialize(world, this);
-            }
-            level->set_display_position(vec3(13 * i, 0, 11 * j));
+    const auto start = std::chrono::steady_clock::now();
+
+    _world = world;
+    resources_t *res = world->get_resources();
+    resolve_graphics(res);
+
+    if (is_procedural()) {
+        /* levels are streamed in as the player moves */
+        if (_generator == nullptr) {
+            _generator = new level_generator_t(_seed, res, this, _palette);
+        }
+        return;
+    }
+
+    std::vector<level_t *> levels;
+    for_each_level([&levels](size_t, size_t, level_t *level) {
+        if (level->is_initialized() == false) {
+            levels.push_back(level);
+        }
+    });
+
+    const size_t count = levels.size();
+    mesh_builder_t *builders = new mesh_builder_t[count];
+    for (size_t i = 0; i < count; i++) {
+        warp_mesh_builder_init(builders + i, res);
+    }
+
+    const size_t threads_count = get_assembly_threads_count(count);
+    assemble_meshes(levels.data(), builders, count, this, threads_count);
+
+    /* mesh resources are created on the main thread only */
+    for (size_t i = 0; i < count; i++) {
+        levels[i]->initialize_from_mesh(world, builders + i);
+        warp_mesh_builder_destroy(builders + i);
+        _resident_bytes += levels[i]->get_mesh_size();
+    }
+    delete [] builders;
+
+    for_each_level([](size_t i, size_t j, level_t *level) {
+        level->set_display_position(vec3(13 * i, 0, 11 * j));
+    });
+
+    warp_log_d( "Initialized %zu levels in %.2f ms using %zu threads."
+              , count, elapsed_ms(start), threads_count
+              );
+}
+
+void region_t::benchmark_mesh_assembly(resources_t *res, size_t levels_count) {
+    resolve_graphics(res);
+
+    std::vector<level_t *> resident;
+    for_each_level([&resident](size_t, size_t, level_t *level) {
+        resident.push_back(level);
+    });
+    if (resident.empty()) {
+        warp_log_e("Cannot benchmark mesh assembly, no resident levels.");
+        return;
+    }
+
+    std::vector<level_t *> levels(levels_count);
+    for (size_t i = 0; i < levels_count; i++) {
+        levels[i] = resident[i % resident.size()];
+    }
+
+    mesh_builder_t *builders = new mesh_builder_t[levels_count];
+    const size_t max_threads = get_assembly_threads_count(levels_count);
+    for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+        for (size_t i = 0; i < levels_count; i++) {
+            warp_mesh_builder_init(builders + i, res);
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        assemble_meshes(levels.data(), builders, levels_count, this, threads);
+        const double time = elapsed_ms(start);
+
+        for (size_t i = 0; i < levels_count; i++) {
+            warp_mesh_builder_destroy(builders + i);
         }
+
+        warp_log_d( "Assembled %zu levels in %.2f ms using %zu threads."
+                  , levels_count, time, threads
+                  );
     }
+    delete [] builders;
 }
 
 bool region_t::add_portal
@@ -88,10 +363,21 @@ bool region_t::add_portal
 
 bool region_t::add_tile_graphics
         (const warp_tag_t &name, const char *mesh, const char *tex) {
-    const tile_graphics_t g = { name, warp_str_create(mesh), warp_str_create(tex) };
+    const tile_graphics_t g = 
+        { name, warp_str_create(mesh), warp_str_create(tex), WARP_RES_ID_INVALID };
     return warp_array_append(&_graphics, &g, 1);
 }
 
+void region_t::resolve_graphics(resources_t *res) {
+    const size_t count = warp_array_get_size(&_graphics);
+    for (size_t i = 0; i < count; i++) {
+        tile_graphics_t *g = (tile_graphics_t *)warp_array_get(&_graphics, i);
+        if (g->mesh_id == WARP_RES_ID_INVALID) {
+            g->mesh_id = warp_resources_load(res, warp_str_value(&g->mesh));
+        }
+    }
+}
+
 void region_t::set_lighting(const region_lighting_t *lighting) {
     if (lighting != nullptr) {
         _lighting = *lighting;
@@ -102,58 +388,241 @@ const portal_t *region_t::get_portal(size_t id) {
     return (const portal_t *) warp_array_get(&_portals, id);
 }
 
-const tile_graphics_t *region_t::get_tile_graphics(const warp_tag_t &tag) const {
-    const size_t count = warp_array_get_size(&_graphics);
-    for (size_t i = 0; i < count; i++) {
-        const tile_graphics_t *tg = (const tile_graphics_t *)warp_array_get(&_graphics, i);
-        if (warp_tag_equals(&tg->name, &tag)) return tg;
+const tile_graphics_t *region_t::get_tile_graphics(graphics_id_t id) const {
+    if (id >= warp_array_get_size(&_graphics)) {
+        return NULL;
+    }
+    return (const tile_graphics_t *)warp_array_get(&_graphics, id);
+}
+
+warp_res_id_t region_t::get_graphics_mesh(graphics_id_t id) const {
+    const tile_graphics_t *graphics = get_tile_graphics(id);
+    return graphics == NULL ? WARP_RES_ID_INVALID : graphics->mesh_id;
+}
+
+void region_t::for_each_slot
+        (std::function<void(size_t x, size_t z, level_slot_t *)> function) {
+    for (auto &entry : _chunks) {
+        const uint32_t chunk_x = entry.first >> 32;
+        const uint32_t chunk_z = entry.first & UINT32_MAX;
+        for (size_t i = 0; i < LEVEL_CHUNK_SIZE * LEVEL_CHUNK_SIZE; i++) {
+            const size_t x = get_chunk_coordinate(chunk_x, i % LEVEL_CHUNK_SIZE);
+            const size_t z = get_chunk_coordinate(chunk_z, i / LEVEL_CHUNK_SIZE);
+            function(x, z, entry.second->slots + i);
+        }
     }
-    return NULL;
+}
+
+void region_t::for_each_level
+        (std::function<void(size_t x, size_t z, level_t *)> function) {
+    for_each_slot([&function](size_t x, size_t z, level_slot_t *slot) {
+        if (slot->level != NULL) {
+            function(x, z, slot->level);
+        }
+    });
 }
 
 void region_t::animate_transition
         (size_t new_x, size_t new_z, size_t old_x, size_t old_z, float k) {
-    const int ddx = (int)new_x - (int)old_x;
-    const int ddz = (int)new_z - (int)old_z;
+    collect_generated_levels();
 
-    for (size_t i = 0; i < _width; i++) {
-        for (size_t j = 0; j < _height; j++) {
-            level_t *level = _levels[i + _width * j];
+    const int ddx = get_offset(new_x, old_x);
+    const int ddz = get_offset(new_z, old_z);
 
-            const int dx = (int)i - (int)old_x;
-            const int dz = (int)j - (int)old_z;
-            const bool visible = abs(dx) <= 2 && abs(dz) <= 2;
+    for_each_level([=](size_t i, size_t j, level_t *level) {
+        const int dx = get_offset(i, old_x);
+        const int dz = get_offset(j, old_z);
+        const bool visible = abs(dx) <= 2 && abs(dz) <= 2;
 
-            const float x = 13 * (dx - k * ddx);
-            const float z = 11 * (dz - k * ddz);
+        const float x = 13 * (dx - k * ddx);
+        const float z = 11 * (dz - k * ddz);
 
-            level->set_display_position(vec3(x, 0, z));
-            level->set_visiblity(visible);
-        }
-    }
+        level->set_display_position(vec3(x, 0, z));
+        level->set_visiblity(visible);
+    });
 }
 
 void region_t::change_display_positions(size_t current_x, size_t current_z) {
-    for (size_t i = 0; i < _width; i++) {
-        for (size_t j = 0; j < _height; j++) {
-            level_t *level = _levels[i + _width * j];
+    _current_x = current_x;
+    _current_z = current_z;
+
+    if (_procedural) {
+        stream_levels(current_x, current_z);
+    } else if (_source != nullptr) {
+        page_levels(current_x, current_z);
+    }
+
+    for_each_level([=](size_t i, size_t j, level_t *level) {
+        const int dx = get_offset(i, current_x);
+        const int dz = get_offset(j, current_z);
+        const bool visible = abs(dx) <= 1 && abs(dz) <= 1;
+
+        level->set_display_position(vec3(13 * dx, 0, 11 * dz));
+        level->set_visiblity(visible);
+    });
+}
+
+level_t *region_t::get_level_at(size_t x, size_t y) {
+    if (_procedural == false && (x >= _width || y >= _height)) {
+        warp_log_e("Cannot obtain level at: %zu, %zu.", x, y);
+        return NULL;
+    }
+
+    collect_generated_levels();
+    level_slot_t *slot = find_slot(x, y);
+    if (slot != NULL && slot->level != NULL) {
+        slot->last_used = ++_clock;
+        return slot->level;
+    }
+    if (slot != NULL && slot->length > 0) {
+        return page_in(slot);
+    }
+    if (_procedural == false) {
+        return NULL; /* hole in the region */
+    }
+    if (_generator == nullptr) {
+        warp_log_e("Cannot generate level, region is not initialized.");
+        return NULL;
+    }
+
+    warp_log_d("Generating level at: %zu, %zu on the main thread.", x, y);
+    generated_level_t generated;
+    _generator->generate(x, y, &generated);
+    add_generated_level(&generated);
+    return generated.level;
+}
+
+void region_t::add_generated_level(generated_level_t *generated) {
+    level_slot_t *slot = create_slot(generated->x, generated->z);
+    if (slot->level != NULL) {
+        /* level was also generated on the main thread */
+        destroy_generated_level(generated);
+        return;
+    }
+
+    level_t *level = generated->level;
+    level->initialize_from_mesh(_world, &generated->builder);
+    level->set_visiblity(false);
+    warp_mesh_builder_destroy(&generated->builder);
+
+    slot->level = level;
+    slot->last_used = ++_clock;
+}
+
+void region_t::collect_generated_levels() {
+    if (_generator == nullptr) return;
+
+    std::vector<generated_level_t> finished;
+    _generator->collect(&finished);
+    for (generated_level_t &generated : finished) {
+        add_generated_level(&generated);
+    }
+}
+
+void region_t::stream_levels(size_t current_x, size_t current_z) {
+    if (_generator == nullptr) return;
+    collect_generated_levels();
 
-            const int dx = (int)i - (int)current_x;
-            const int dz = (int)j - (int)current_z;
-            const bool visible = abs(dx) <= 1 && abs(dz) <= 1;
+    std::vector<std::pair<size_t, size_t>> far;
+    for_each_level([&far, current_x, current_z](size_t x, size_t z, level_t *) {
+        const size_t dx = get_level_distance(x, current_x);
+        const size_t dz = get_level_distance(z, current_z);
+        if (dx > DROP_RADIUS || dz > DROP_RADIUS) {
+            far.push_back(std::make_pair(x, z));
+        }
+    });
+    for (const auto &coords : far) {
+        level_t *level = find_slot(coords.first, coords.second)->level;
+        level->release(_world);
+        delete level;
+        remove_slot(coords.first, coords.second);
+    }
 
-            level->set_display_position(vec3(13 * dx, 0, 11 * dz));
-            level->set_visiblity(visible);
+    _generator->retain(current_x, current_z, PREFETCH_RADIUS);
+
+    /* rings closer to the player are queued first */
+    const int radius = PREFETCH_RADIUS;
+    for (int r = 0; r <= radius; r++) {
+        for (int dx = -r; dx <= r; dx++) {
+            for (int dz = -r; dz <= r; dz++) {
+                if (abs(dx) != r && abs(dz) != r) continue;
+
+                const size_t x = current_x + dx;
+                const size_t z = current_z + dz;
+                const level_slot_t *slot = find_slot(x, z);
+                if (slot == NULL || slot->level == NULL) {
+                    _generator->request(x, z);
+                }
+            }
         }
     }
 }
 
-level_t *region_t::get_level_at(size_t x, size_t y) const {
-    if (x >= _width || y >= _height) {
-        warp_log_e("Cannot obtain level at: %zu, %zu.", x, y);
+level_t *region_t::page_in(level_slot_t *slot) {
+    const level_location_t location = { slot->offset, slot->length };
+    warp_result_t result 
+        = read_level_from_source(_source, &location, _palette, &slot->level);
+    if (WARP_FAILED(result)) {
+        warp_result_log("Failed to page in level", &result);
+        warp_result_destory(&result);
         return NULL;
     }
-    return _levels[x + _width * y];
+
+    level_t *level = slot->level;
+    slot->last_used = ++_clock;
+    if (_world != nullptr) {
+        level->initialize(_world, this);
+        level->set_visiblity(false);
+    }
+    _resident_bytes += get_resident_size(level);
+
+    page_out_over_budget(_current_x, _current_z, slot);
+    warp_log_d( "Paged in level, %zu of %zu bytes budget resident."
+              , _resident_bytes, _budget
+              );
+    return level;
+}
+
+/* levels that can be displayed are kept resident */
+void region_t::page_levels(size_t current_x, size_t current_z) {
+    const int radius = 1;
+    for (int dx = -radius; dx <= radius; dx++) {
+        for (int dz = -radius; dz <= radius; dz++) {
+            const size_t x = current_x + dx;
+            const size_t z = current_z + dz;
+            if (x >= _width || z >= _height) continue;
+
+            level_slot_t *slot = find_slot(x, z);
+            if (slot != NULL && slot->level == NULL && slot->length > 0) {
+                page_in(slot);
+            }
+        }
+    }
+    page_out_over_budget(current_x, current_z, NULL);
+}
+
+/* least recently used levels go first, neighbours of the current level stay */
+void region_t::page_out_over_budget
+        (size_t current_x, size_t current_z, const level_slot_t *keep) {
+    if (_budget == 0) return;
+
+    while (_resident_bytes > _budget) {
+        level_slot_t *oldest = NULL;
+        for_each_slot([&](size_t x, size_t z, level_slot_t *slot) {
+            if (slot->level == NULL || slot->length == 0 || slot == keep) return;
+            if (get_level_distance(x, current_x) <= 2
+                    && get_level_distance(z, current_z) <= 2) return;
+            if (oldest == NULL || slot->last_used < oldest->last_used) {
+                oldest = slot;
+            }
+        });
+        if (oldest == NULL) break;
+
+        _resident_bytes -= get_resident_size(oldest->level);
+        oldest->level->release(_world);
+        delete oldest->level;
+        oldest->level = NULL;
+    }
 }
 
 region_t *generate_random_region(warp_random_t *random) {
@@ -165,14 +634,16 @@ region_t *generate_random_region(warp_random_t *random) {
 
     const size_t width = 9;
     const size_t height = 9;
+    const uint32_t seed = warp_random_next(random);
+    tile_palette_t *palette = new tile_palette_t;
     level_t * levels[width * height];
     for (size_t i = 0; i < width; i++) {
         for (size_t j = 0; j < height; j++) {
-            levels[i + width * j] = generate_random_level(random);
+            levels[i + width * j] = generate_level_at(seed, i, j, palette);
         }
     }
     
-    region_t *region = new region_t(levels, width, height);
+    region_t *region = new region_t(levels, width, height, palette);
     if (local_random) {
         warp_random_destroy(random);
     }
@@ -207,18 +678,19 @@ static dir_t parse_direction(const char *dir) {
     return DIR_NONE;
 }
 
-static void fill_default_tile(tile_t *tile) {
-    if (tile == nullptr) return;
+static graphics_id_t get_graphics_id
+        (const warp_map_t *graphics_ids, const char *name) {
+    if (name == nullptr) return GRAPHICS_ID_INVALID;
 
-    tile->is_walkable = true;
-    tile->is_stairs = false;
-    tile->spawn_probablity = 0;
-    tile->object_dir = DIR_NONE;
-    tile->feature = FEAT_NONE;
-    tile->feat_target_id = 0;
+    const void *id = warp_map_tag_get(graphics_ids, WARP_TAG(name));
+    if (id == nullptr) {
+        warp_log_e("Cannot find tile graphics with name: %s.", name);
+        return GRAPHICS_ID_INVALID;
+    }
+    return *(const graphics_id_t *)id;
 }
 
-static tile_t parse_tile(JSON_Object *tile) {
+static tile_t parse_tile(JSON_Object *tile, const warp_map_t *graphics_ids) {
     tile_t result;
     fill_default_tile(&result);
     
@@ -251,7 +723,8 @@ static tile_t parse_tile(JSON_Object *tile) {
         result.portal_id = json_object_dotget_number(tile, "portalId");
     }
     if (json_object_get_value(tile, "graphics") != nullptr) {
-        result.graphics_id = WARP_TAG(json_object_dotget_string(tile, "graphics"));
+        const char *name = json_object_get_string(tile, "graphics");
+        result.graphics_id = get_graphics_id(graphics_ids, name);
     }
     
     return result;
@@ -263,7 +736,10 @@ static char get_tile_symbol(JSON_Object *tile) {
     return symbol[0];
 }
 
-static void fill_tiles_map(std::map<char, tile_t> *map, JSON_Array *tiles) {
+static void fill_tiles_map
+        ( std::map<char, tile_t> *map, JSON_Array *tiles
+        , const warp_map_t *graphics_ids
+        ) {
     if (tiles == nullptr) return;
     
     const size_t count = json_array_get_count(tiles);
@@ -271,7 +747,7 @@ static void fill_tiles_map(std::map<char, tile_t> *map, JSON_Array *tiles) {
         JSON_Object *tile = json_array_get_object(tiles, i);
         const char symbol = get_tile_symbol(tile);
         if (symbol != '\0'){
-            map->insert(std::make_pair(symbol, parse_tile(tile)));
+            map->insert(std::make_pair(symbol, parse_tile(tile, graphics_ids)));
         }
     }
 }
@@ -289,13 +765,15 @@ static void prase_level_data
     }
 }
 
-static void parse_level_decorations(JSON_Array *decors, decoration_t *ds) {
+static void parse_level_decorations
+        (JSON_Array *decors, decoration_t *ds, const warp_map_t *graphics_ids) {
     for (size_t i = 0; i < json_array_get_count(decors); i++) {
         JSON_Object *decor = json_array_get_object(decors, i);
         decoration_t *d = ds + i;
         transforms_init(&d->transforms);
 
-        d->graphics_id = WARP_TAG(json_object_get_string(decor, "graphics"));
+        const char *name = json_object_get_string(decor, "graphics");
+        d->graphics_id = get_graphics_id(graphics_ids, name);
 
         vec3_t position;
         position.x = json_object_dotget_number(decor, "position.x");
@@ -316,13 +794,15 @@ static void parse_level_decorations(JSON_Array *decors, decoration_t *ds) {
 static void parse_level
         ( level_t **parsed, JSON_Object *level
         , const std::map<char, tile_t> &global_map
+        , const warp_map_t *graphics_ids
+        , tile_palette_t *palette
         ) {
     const size_t width = 13;
     const size_t height = 11;
 
     std::map<char, tile_t> local_map;
     JSON_Array *local_tiles = json_object_dotget_array(level, "tiles");
-    fill_tiles_map(&local_map, local_tiles);
+    fill_tiles_map(&local_map, local_tiles, graphics_ids);
 
     JSON_Array *data = json_object_dotget_array(level, "data");
 
@@ -346,12 +826,27 @@ static void parse_level
     if (decors) { 
         decors_count = json_array_get_count(decors);
         decorations = new decoration_t[decors_count];
-        parse_level_decorations(decors, decorations);
+        parse_level_decorations(decors, decorations, graphics_ids);
     }
 
-    *parsed = new level_t(tiles, width, height, decorations, decors_count);
+    *parsed = new level_t
+        (tiles, width, height, decorations, decors_count, palette);
+    delete [] decorations;
+}
+
+static void fill_graphics_ids(warp_map_t *graphics_ids, JSON_Array *graphics) {
+    if (graphics == nullptr) return;
+
+    const size_t count = json_array_get_count(graphics);
+    for (size_t i = 0; i < count; i++) {
+        JSON_Object *g = json_array_get_object(graphics, i);
+        const char *name = json_object_get_string(g, "name");
+        const graphics_id_t id = i;
+        warp_map_tag_insert(graphics_ids, WARP_TAG(name), &id);
+    }
 }
 
+/* must add graphics in the same order as fill_graphics_ids assigns ids */
 static void add_graphics(region_t *region, JSON_Array *graphics) {
     if (graphics == nullptr) return;
 
@@ -440,23 +935,33 @@ static region_t *parse_json(const JSON_Object *root) {
         return nullptr;
     }
 
+    JSON_Array *graphics = json_object_get_array(root, "graphics");
+    warp_map_t graphics_ids = warp_map_create_typed(graphics_id_t, NULL);
+    fill_graphics_ids(&graphics_ids, graphics);
+
     std::map<char, tile_t> global_map;
     JSON_Array *global_tiles = json_object_get_array(root, "tiles");
-    fill_tiles_map(&global_map, global_tiles);
+    fill_tiles_map(&global_map, global_tiles, &graphics_ids);
 
+    tile_palette_t *palette = new tile_palette_t;
     level_t **parsed_levels = new level_t * [count];
     for (size_t i = 0; i < count; i++) {
         JSON_Object *level = json_array_get_object(levels, i);
-        parse_level(parsed_levels + i, level, global_map);
+        if (level == nullptr) {
+            parsed_levels[i] = NULL; /* hole in the region */
+            continue;
+        }
+        parse_level
+            (parsed_levels + i, level, global_map, &graphics_ids, palette);
     }
+    warp_map_destroy(&graphics_ids);
 
-    region_t *region = new region_t(parsed_levels, width, height);
+    region_t *region = new region_t(parsed_levels, width, height, palette);
     delete [] parsed_levels;
     
     JSON_Array *portals = json_object_get_array(root, "portals");
     add_portals(region, portals);
 
-    JSON_Array *graphics = json_object_get_array(root, "graphics");
     add_graphics(region, graphics);
 
     JSON_Object *lighting = json_object_get_object(root, "lighting");
@@ -467,52 +972,221 @@ static region_t *parse_json(const JSON_Object *root) {
     return region;
 }
 
-extern region_t *load_region(const char *name) {
-    region_t *result = NULL;
-    const char *filepath = NULL;
-    const char *content = NULL;
+static region_t *parse_document(const char *name, const char *content) {
+    JSON_Value *root_value = json_parse_string(content);
+    if (json_value_get_type(root_value) != JSONObject) {
+        warp_log_e("Cannot parse %s: root element is not an object.", name);
+        json_value_free(root_value);
+        return NULL;
+    }
 
-    warp_array_t bytes = { NULL };
+    region_t *result = parse_json(json_value_get_object(root_value));
+    json_value_free(root_value);
+    return result;
+}
 
+static bool read_region_file
+        (const char *name, warp_array_t *bytes, warp_str_t *out_path) {
     warp_str_t path = warp_str_format("assets/levels/%s", name);
-    warp_str_t out_path = { NULL };
-    
+    bool success = false;
+
     warp_result_t find_result;
     warp_result_t read_result;
 
-    JSON_Value *root_value = NULL;
-    const JSON_Object *root = NULL;
-
-    find_result = find_path(&path, &out_path);
+    find_result = find_path(&path, out_path);
     if (WARP_FAILED(find_result)) {
         warp_result_log("Failed to find region file path", &find_result);
         warp_result_destory(&find_result);
         goto cleanup;
     }
 
-    filepath = warp_str_value(&out_path);
-    read_result = read_file(filepath, &bytes);
+    read_result = read_file(warp_str_value(out_path), bytes);
     if (WARP_FAILED(read_result)) {
         warp_result_log("Failed to read region file", &read_result);
         warp_result_destory(&read_result);
         goto cleanup;
     }
+    success = true;
 
-    content = (char *) warp_array_get(&bytes, 0);
-    root_value = json_parse_string(content);
-    if (json_value_get_type(root_value) != JSONObject) {
-       warp_log_e("Cannot parse %s: root element is not an object.", path);
-       goto cleanup;
-    }
-    root = json_value_get_object(root_value);
-    result = parse_json(root);
-    
 cleanup:
     warp_str_destroy(&path);
-    warp_str_destroy(&out_path);
+    return success;
+}
+
+extern region_t *load_region(const char *name, size_t levels_budget) {
+    unsigned int seed = 0;
+    if (sscanf(name, "procedural-%u", &seed) == 1) {
+        return new region_t((uint32_t)seed);
+    }
+
+    warp_array_t bytes = { NULL };
+    warp_str_t path = { NULL };
+    if (read_region_file(name, &bytes, &path) == false) {
+        warp_array_destroy(&bytes);
+        warp_str_destroy(&path);
+        return NULL;
+    }
+
+    region_t *result = NULL;
+    const char *content = (char *) warp_array_get(&bytes, 0);
+    const region_read_options_t options = 
+        { warp_str_value(&path), levels_budget };
+
+    /* documents not suitable for single pass are parsed into a tree */
+    warp_result_t stream_result
+        = read_region_stream(content, &options, &result, NULL);
+    if (WARP_FAILED(stream_result)) {
+        warp_result_log("Falling back to document parser", &stream_result);
+        warp_result_destory(&stream_result);
+        result = parse_document(name, content);
+    }
+
     warp_array_destroy(&bytes);
+    warp_str_destroy(&path);
+    return result;
+}
+
+static size_t json_allocated = 0;
+static size_t json_peak_allocated = 0;
+
+/* block size is stored in front of the block, two words keep alignment */
+static void *counting_malloc(size_t size) {
+    size_t *block = (size_t *) malloc(size + 2 * sizeof (size_t));
+    if (block == NULL) return NULL;
+
+    block[0] = size;
+    json_allocated += size;
+    if (json_allocated > json_peak_allocated) {
+        json_peak_allocated = json_allocated;
+    }
+    return block + 2;
+}
+
+static void counting_free(void *ptr) {
+    if (ptr == NULL) return;
+
+    size_t *block = (size_t *) ptr - 2;
+    json_allocated -= block[0];
+    free(block);
+}
+
+/* repeats levels of the region to fill width by height grid */
+static char *create_synthetic_region
+        (const char *content, size_t width, size_t height) {
+    JSON_Value *root_value = json_parse_string(content);
+    JSON_Object *root = json_value_get_object(root_value);
+    JSON_Array *levels = json_object_get_array(root, "levels");
+    const size_t levels_count = json_array_get_count(levels);
+    if (levels_count == 0) {
+        json_value_free(root_value);
+        return NULL;
+    }
+
+    JSON_Value *synthetic_value = json_value_init_array();
+    JSON_Array *synthetic = json_value_get_array(synthetic_value);
+    for (size_t i = 0; i < width * height; i++) {
+        JSON_Value *level = json_array_get_value(levels, i % levels_count);
+        json_array_append_value(synthetic, json_value_deep_copy(level));
+    }
+    json_object_set_value(root, "levels", synthetic_value);
+    json_object_set_number(root, "width", width);
+    json_object_set_number(root, "height", height);
+
+    char *serialized = json_serialize_to_string(root_value);
     json_value_free(root_value);
+    return serialized;
+}
 
-    return result;
+static void benchmark_parsing(const char *label, const char *content) {
+    const size_t iterations = 8;
+    const double megabytes = iterations * strlen(content) / (1024.0 * 1024.0);
+
+    json_allocated = 0;
+    json_peak_allocated = 0;
+    json_set_allocation_functions(counting_malloc, counting_free);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++) {
+        delete parse_document(label, content);
+    }
+    const double document_time = elapsed_ms(start);
+    json_set_allocation_functions(malloc, free);
+
+    region_read_stats_t stats = { 0 };
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++) {
+        region_t *region = NULL;
+        warp_result_t result
+            = read_region_stream(content, NULL, &region, &stats);
+        warp_result_destory(&result);
+        delete region;
+    }
+    const double stream_time = elapsed_ms(start);
+
+    /* levels are left out on both sides, the document peak counts only
+     * parson allocations and the stream only its own scratch memory */
+    warp_log_d( "Parsed %s: document %.1f MB/s, tree peak %zu KB;"
+                " stream %.1f MB/s, reader overhead %zu KB."
+              , label
+              , megabytes / (document_time / 1000.0)
+              , json_peak_allocated / 1024
+              , megabytes / (stream_time / 1000.0)
+              , stats.scratch_bytes / 1024
+              );
+}
+
+/* levels used to keep a full tile_t per cell */
+static void log_level_storage(const char *name, region_t *region) {
+    const size_t count = region->get_levels_count();
+    if (count == 0) return;
+
+    const size_t cells = 13 * 11;
+    const size_t tile_array_bytes = cells * sizeof (tile_t);
+    const size_t prototypes = region->get_tile_palette()->get_size();
+    const size_t palette_bytes = prototypes * sizeof (tile_t);
+    const size_t bytes = region->get_resident_bytes() + palette_bytes;
+
+    warp_log_d( "Level storage of %s: %zu tiles took %zu bytes per level,"
+                " %zu prototypes and cells take %zu bytes per level."
+              , name, cells, tile_array_bytes, prototypes, bytes / count
+              );
 }
 
+extern void benchmark_region(resources_t *res, const char *name) {
+    warp_array_t bytes = { NULL };
+    warp_str_t path = { NULL };
+    const bool read = read_region_file(name, &bytes, &path);
+    warp_str_destroy(&path);
+    if (read == false) {
+        warp_log_e("Cannot benchmark region: '%s', failed to read.", name);
+        warp_array_destroy(&bytes);
+        return;
+    }
+
+    const char *content = (char *) warp_array_get(&bytes, 0);
+    benchmark_parsing(name, content);
+
+    char *synthetic = create_synthetic_region(content, 32, 32);
+    if (synthetic != NULL) {
+        benchmark_parsing("synthetic 32x32 region", synthetic);
+        json_free_serialized_string(synthetic);
+    }
+    warp_array_destroy(&bytes);
+
+    region_t *region = load_region(name, 0);
+    if (region == NULL) {
+        warp_log_e("Cannot benchmark region: '%s', failed to load.", name);
+        return;
+    }
+
+    log_level_storage(name, region);
+
+    const size_t levels_count = region->get_levels_count();
+    warp_log_d("Benchmarking mesh assembly of region: '%s'.", name);
+    region->benchmark_mesh_assembly(res, levels_count);
+
+    const size_t synthetic_count = 32 * 32;
+    warp_log_d("Benchmarking mesh assembly of synthetic 32x32 region.");
+    region->benchmark_mesh_assembly(res, synthetic_count);
+
+    delete region;
+}
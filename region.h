@@ -5,8 +5,11 @@
 #include "warp/utils/tag.h"
 #include "warp/utils/str.h"
 #include "warp/math/vec3.h"
+#include "warp/resources/resources.h"
 
-class level_t;
+#include <unordered_map>
+
+#include "level.h"
 
 namespace warp {
     class world_t;
@@ -22,17 +25,48 @@ struct tile_graphics_t {
     warp_tag_t name;
     warp_str_t mesh;
     warp_str_t texture;
+    warp_res_id_t mesh_id; /* resolved when the region is initialized */
 };
 
+class level_generator_t;
+struct generated_level_t;
+struct region_source_t;
+struct level_location_t;
+
 struct region_lighting_t {
     warp_vec3_t sun_color;
     warp_vec3_t sun_direction;
     warp_vec3_t ambient_color;
 };
 
+/// Cell of the region grid, levels of a file backed region may be paged out
+/// and read again from their location in the file.
+struct level_slot_t {
+    level_t *level;
+    size_t offset;
+    size_t length; /* zero when level cannot be paged in */
+    uint64_t last_used;
+};
+
+#define LEVEL_CHUNK_SIZE 8
+
+/// Square of neighbouring slots, chunks are only created where the region
+/// has any levels.
+struct level_chunk_t {
+    level_slot_t slots[LEVEL_CHUNK_SIZE * LEVEL_CHUNK_SIZE];
+};
+
 class region_t {
     public:
-        region_t(level_t **levels, size_t width, size_t height);
+        /// Null levels are holes in the region grid, region takes ownership
+        /// of the palette their tiles were interned in.
+        region_t
+            ( level_t **levels, size_t width, size_t height
+            , tile_palette_t *palette
+            );
+        /// Creates unbounded region, its levels are generated from seed and
+        /// coordinates when approached and dropped when left far behind.
+        explicit region_t(uint32_t seed);
         ~region_t();
 
         void initialize(warp::world_t *world);
@@ -47,29 +81,83 @@ class region_t {
         bool add_tile_graphics
             (const warp_tag_t &name, const char *mesh, const char *texture);
         void set_lighting(const region_lighting_t *lighting);
+        /// Lets the region page levels in from the region file, resident
+        /// levels are kept within budget bytes, zero means no limit.
+        void set_level_source
+            ( region_source_t *source, const level_location_t *locations
+            , size_t budget
+            );
+
+        /// Logs time of level mesh assembly against worker threads count,
+        /// levels_count levels are assembled by cycling through the region.
+        void benchmark_mesh_assembly(warp_resources_t *res, size_t levels_count);
 
         inline bool is_initialized() const { return _initialized; }
+        inline bool is_procedural() const { return _procedural; }
         inline size_t get_width() const { return _width; }
         inline size_t get_height() const { return _height; }
+        inline tile_palette_t *get_tile_palette() const { return _palette; }
+        inline size_t get_resident_bytes() const { return _resident_bytes; }
+        /// Number of levels in the region, resident or not, holes excluded.
+        size_t get_levels_count() const;
 
-        level_t *get_level_at(size_t x, size_t y) const;
+        level_t *get_level_at(size_t x, size_t y);
         const portal_t *get_portal(size_t id);
-        const tile_graphics_t *get_tile_graphics(const warp_tag_t &id) const;
+        const tile_graphics_t *get_tile_graphics(graphics_id_t id) const;
+        warp_res_id_t get_graphics_mesh(graphics_id_t id) const;
         const region_lighting_t *get_region_lighting() const { return &_lighting; }
 
+    private:
+        void resolve_graphics(warp_resources_t *res);
+        level_slot_t *find_slot(size_t x, size_t z) const;
+        level_slot_t *create_slot(size_t x, size_t z);
+        void remove_slot(size_t x, size_t z);
+        void for_each_slot
+            (std::function<void(size_t x, size_t z, level_slot_t *)> function);
+        void for_each_level
+            (std::function<void(size_t x, size_t z, level_t *)> function);
+
+        void add_generated_level(generated_level_t *generated);
+        void collect_generated_levels();
+        void stream_levels(size_t current_x, size_t current_z);
+
+        level_t *page_in(level_slot_t *slot);
+        void page_levels(size_t current_x, size_t current_z);
+        void page_out_over_budget
+            (size_t current_x, size_t current_z, const level_slot_t *keep);
+
     private:
         bool _initialized;
         
         size_t _width;
         size_t _height;
+        bool _procedural;
+        uint32_t _seed;
 
-        level_t **_levels;
+        std::unordered_map<uint64_t, level_chunk_t *> _chunks;
+        tile_palette_t *_palette;
         
         warp_array_t _portals;
         warp_array_t _graphics;
 
         region_lighting_t _lighting;
+
+        warp::world_t *_world;
+        level_generator_t *_generator;
+
+        region_source_t *_source;
+        size_t _budget;
+        size_t _resident_bytes;
+        uint64_t _clock;
+        size_t _current_x;
+        size_t _current_z;
 };
 
 region_t *generate_random_region(warp_random_t *random);
-region_t *load_region(const char *path);
+/// Loads region from assets/levels, name 'procedural-<seed>' gives instead
+/// an unbounded region generated with that seed. Levels over levels_budget
+/// bytes are read from the region file when needed, zero means no limit.
+region_t *load_region(const char *path, size_t levels_budget);
+/// Logs parsing and mesh assembly times of the region. Swaps allocation
+/// functions of parson, no other thread may parse json while it runs.
+void benchmark_region(warp_resources_t *res, const char *path);
@@ -0,0 +1,960 @@
+#define WARP_DROP_PREFIX
+#include "region_reader.h"
+
+#include <stdlib.h> /* strtod */
+#include <stdio.h>  /* fopen */
+#include <cstring>
+#include <vector>
+
+#include "warp/utils/log.h"
+#include "warp/utils/tag.h"
+#include "warp/collections/map.h"
+#include "warp/utils/str.h"
+
+#include "level.h"
+#include "region.h"
+
+using namespace warp;
+
+static const size_t LEVEL_WIDTH = 13;
+static const size_t LEVEL_HEIGHT = 11;
+static const size_t SYMBOLS_COUNT = 256;
+static const size_t MAX_NAME_LENGTH = 256;
+
+/* tokenizer: */
+
+enum json_token_type_t {
+    JTOK_ERROR = 0,
+    JTOK_END,
+    JTOK_OBJECT_BEGIN,
+    JTOK_OBJECT_END,
+    JTOK_ARRAY_BEGIN,
+    JTOK_ARRAY_END,
+    JTOK_STRING,
+    JTOK_NUMBER,
+    JTOK_LITERAL, /* true, false or null */
+    JTOK_COLON,
+    JTOK_COMMA,
+};
+
+struct json_token_t {
+    json_token_type_t type;
+    const char *start;
+    size_t length;
+    bool escaped; /* string has escape sequences, see copy_token */
+};
+
+struct json_stream_t {
+    const char *cursor;
+    json_token_t token;
+    bool failed;
+};
+
+static void init_stream(json_stream_t *stream, const char *content) {
+    stream->cursor = content;
+    stream->token.type = JTOK_ERROR;
+    stream->token.start = content;
+    stream->token.length = 0;
+    stream->token.escaped = false;
+    stream->failed = false;
+}
+
+static bool is_white_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static bool is_delimiter(char c) {
+    return c == '\0' || is_white_space(c) || c == ':' || c == ','
+        || c == '{' || c == '}' || c == '[' || c == ']' || c == '"';
+}
+
+static int read_hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/* reads XXXX of \uXXXX escape, returns false if it is not four hex digits */
+static bool read_code_unit(const char *c, unsigned *unit) {
+    *unit = 0;
+    for (int i = 0; i < 4; i++) {
+        const int digit = read_hex_digit(c[i]);
+        if (digit < 0) return false;
+        *unit = (*unit << 4) | digit;
+    }
+    return true;
+}
+
+static bool is_high_surrogate(unsigned unit) { return unit >= 0xd800 && unit < 0xdc00; }
+static bool is_low_surrogate(unsigned unit)  { return unit >= 0xdc00 && unit < 0xe000; }
+
+/* Reads escape sequence at c, just past the backslash. Returns count of
+ * characters it takes or zero if it is invalid, like parson surrogates
+ * have to come in pairs. */
+static size_t read_escape(const char *c, unsigned *code_point) {
+    switch (*c) {
+        case '"':  *code_point = '"';  return 1;
+        case '\\': *code_point = '\\'; return 1;
+        case '/':  *code_point = '/';  return 1;
+        case 'b':  *code_point = '\b'; return 1;
+        case 'f':  *code_point = '\f'; return 1;
+        case 'n':  *code_point = '\n'; return 1;
+        case 'r':  *code_point = '\r'; return 1;
+        case 't':  *code_point = '\t'; return 1;
+        case 'u': break;
+        default: return 0;
+    }
+
+    unsigned high;
+    if (read_code_unit(c + 1, &high) == false || is_low_surrogate(high)) return 0;
+    if (is_high_surrogate(high) == false) {
+        *code_point = high;
+        return 5;
+    }
+
+    unsigned low;
+    if (c[5] != '\\' || c[6] != 'u' || read_code_unit(c + 7, &low) == false
+            || is_low_surrogate(low) == false) {
+        return 0;
+    }
+    *code_point = 0x10000 + ((high - 0xd800) << 10) + (low - 0xdc00);
+    return 11;
+}
+
+/* writes code point as utf-8, returns count of bytes */
+static size_t encode_utf8(unsigned code_point, char *output) {
+    if (code_point < 0x80) {
+        output[0] = code_point;
+        return 1;
+    } else if (code_point < 0x800) {
+        output[0] = 0xc0 | (code_point >> 6);
+        output[1] = 0x80 | (code_point & 0x3f);
+        return 2;
+    } else if (code_point < 0x10000) {
+        output[0] = 0xe0 | (code_point >> 12);
+        output[1] = 0x80 | ((code_point >> 6) & 0x3f);
+        output[2] = 0x80 | (code_point & 0x3f);
+        return 3;
+    }
+    output[0] = 0xf0 | (code_point >> 18);
+    output[1] = 0x80 | ((code_point >> 12) & 0x3f);
+    output[2] = 0x80 | ((code_point >> 6) & 0x3f);
+    output[3] = 0x80 | (code_point & 0x3f);
+    return 4;
+}
+
+static json_token_type_t next_token(json_stream_t *stream) {
+    const char *c = stream->cursor;
+    while (is_white_space(*c)) c++;
+
+    json_token_t *token = &stream->token;
+    token->start = c;
+    token->length = 1;
+    token->escaped = false;
+
+    switch (*c) {
+        case '\0':
+            token->type = JTOK_END;
+            token->length = 0;
+            break;
+        case '{': token->type = JTOK_OBJECT_BEGIN; c++; break;
+        case '}': token->type = JTOK_OBJECT_END;   c++; break;
+        case '[': token->type = JTOK_ARRAY_BEGIN;  c++; break;
+        case ']': token->type = JTOK_ARRAY_END;    c++; break;
+        case ':': token->type = JTOK_COLON;        c++; break;
+        case ',': token->type = JTOK_COMMA;        c++; break;
+        case '"': {
+            c++;
+            token->start = c;
+            bool valid = true;
+            while (*c != '"' && *c != '\0' && valid) {
+                if (*c == '\\') {
+                    unsigned code_point;
+                    const size_t length = read_escape(c + 1, &code_point);
+                    valid = length > 0;
+                    token->escaped = true;
+                    c += length;
+                }
+                c++;
+            }
+            token->length = c - token->start;
+            if (*c == '\0' || valid == false) {
+                token->type = JTOK_ERROR;
+            } else {
+                token->type = JTOK_STRING;
+                c++;
+            }
+            break;
+        }
+        default: {
+            const char first = *c;
+            while (is_delimiter(*c) == false) c++;
+            token->length = c - token->start;
+            const bool is_number = first == '-' || (first >= '0' && first <= '9');
+            token->type = is_number ? JTOK_NUMBER : JTOK_LITERAL;
+            break;
+        }
+    }
+
+    stream->cursor = c;
+    return token->type;
+}
+
+/* Copies token to null terminated buffer, decoding escapes of strings the
+ * same way as parson does. Escapes were checked when the token was read. */
+static void copy_token(const json_token_t *token, char *buffer, size_t size) {
+    if (token->escaped == false) {
+        const size_t length = token->length < size - 1 ? token->length : size - 1;
+        memcpy(buffer, token->start, length);
+        buffer[length] = '\0';
+        return;
+    }
+
+    const char *c = token->start;
+    const char *end = token->start + token->length;
+    size_t length = 0;
+    while (c < end) {
+        char decoded[4];
+        size_t decoded_length = 1;
+        decoded[0] = *c;
+        if (*c == '\\') {
+            unsigned code_point = 0;
+            c += read_escape(c + 1, &code_point);
+            decoded_length = encode_utf8(code_point, decoded);
+        }
+        c++;
+
+        if (length + decoded_length > size - 1) break;
+        memcpy(buffer + length, decoded, decoded_length);
+        length += decoded_length;
+    }
+    buffer[length] = '\0';
+}
+
+static bool is_token(const json_token_t *token, const char *literal) {
+    if (token->escaped) {
+        char buffer[MAX_NAME_LENGTH];
+        copy_token(token, buffer, MAX_NAME_LENGTH);
+        return strcmp(buffer, literal) == 0;
+    }
+    const size_t length = strlen(literal);
+    return token->length == length && memcmp(token->start, literal, length) == 0;
+}
+
+static double read_number(json_stream_t *stream) {
+    const json_token_t *token = &stream->token;
+    if (token->type != JTOK_NUMBER) {
+        stream->failed = true;
+        return 0;
+    }
+    return strtod(token->start, NULL);
+}
+
+static bool read_boolean(json_stream_t *stream) {
+    const json_token_t *token = &stream->token;
+    if (token->type != JTOK_LITERAL) {
+        stream->failed = true;
+        return false;
+    }
+    return is_token(token, "true");
+}
+
+static bool expect(json_stream_t *stream, json_token_type_t type) {
+    if (stream->token.type != type) {
+        stream->failed = true;
+        return false;
+    }
+    return true;
+}
+
+static bool is_value_start(json_token_type_t type) {
+    return type == JTOK_OBJECT_BEGIN || type == JTOK_ARRAY_BEGIN
+        || type == JTOK_STRING || type == JTOK_NUMBER || type == JTOK_LITERAL;
+}
+
+/* Moves past the comma between members or elements. The current token is
+ * the last token of the previous value, or the opening token before the
+ * first one. Returns false at the closing token or when the stream fails. */
+static bool next_entry(json_stream_t *stream, json_token_type_t begin, json_token_type_t end) {
+    if (stream->failed) return false;
+
+    const bool first = stream->token.type == begin;
+    json_token_type_t type = next_token(stream);
+    if (type == end) return false;
+    if (first == false) {
+        if (type != JTOK_COMMA) {
+            stream->failed = true;
+            return false;
+        }
+        next_token(stream);
+    }
+    return true;
+}
+
+/* Moves to the next member of current object, the member's value becomes
+ * the current token. Returns false at the end of the object. */
+static bool next_member(json_stream_t *stream, json_token_t *key) {
+    if (next_entry(stream, JTOK_OBJECT_BEGIN, JTOK_OBJECT_END) == false) return false;
+
+    if (stream->token.type != JTOK_STRING) {
+        stream->failed = true;
+        return false;
+    }
+    *key = stream->token;
+    if (next_token(stream) != JTOK_COLON || is_value_start(next_token(stream)) == false) {
+        stream->failed = true;
+        return false;
+    }
+    return true;
+}
+
+/* Moves to the next element of current array, returns false at its end. */
+static bool next_element(json_stream_t *stream) {
+    if (next_entry(stream, JTOK_ARRAY_BEGIN, JTOK_ARRAY_END) == false) return false;
+
+    if (is_value_start(stream->token.type) == false) {
+        stream->failed = true;
+        return false;
+    }
+    return true;
+}
+
+/* After reading a value the current token is the last token of that value,
+ * skip_value follows the same rule for values that are not interesting and
+ * checks their structure as well. */
+static void skip_value(json_stream_t *stream) {
+    const json_token_type_t type = stream->token.type;
+    if (type == JTOK_OBJECT_BEGIN) {
+        json_token_t key;
+        while (next_member(stream, &key)) {
+            skip_value(stream);
+        }
+    } else if (type == JTOK_ARRAY_BEGIN) {
+        while (next_element(stream)) {
+            skip_value(stream);
+        }
+    } else if (is_value_start(type) == false) {
+        stream->failed = true;
+    }
+}
+
+/* region schema: */
+
+struct graphics_entry_t {
+    json_token_t name;
+    json_token_t mesh;
+    json_token_t texture;
+};
+
+struct portal_entry_t {
+    json_token_t region;
+    vec3_t level;
+    vec3_t tile;
+};
+
+struct region_source_t {
+    warp_str_t path;
+    warp_map_t graphics_ids;
+    tile_t global_tiles[SYMBOLS_COUNT];
+    bool global_defined[SYMBOLS_COUNT];
+};
+
+struct region_reader_t {
+    json_stream_t stream;
+    const char *content;
+    region_source_t *source;
+    tile_palette_t *palette;
+    size_t levels_budget;
+    size_t resident_bytes;
+
+    size_t width;
+    size_t height;
+    const char *lighting;
+
+    bool graphics_read;
+    bool tiles_read;
+    bool levels_read;
+
+    std::vector<graphics_entry_t> graphics;
+    std::vector<portal_entry_t> portals;
+    std::vector<level_t *> levels; /* null for holes and paged out levels */
+    std::vector<level_location_t> locations;
+    std::vector<decoration_t> decorations; /* reused by every level */
+
+    tile_t local_tiles[SYMBOLS_COUNT];
+    bool local_defined[SYMBOLS_COUNT];
+};
+
+static feature_type_t read_feature(const json_token_t *type) {
+    if (is_token(type, "FEAT_DOOR")) {
+        return FEAT_DOOR;
+    } else if (is_token(type, "FEAT_BUTTON")) {
+        return FEAT_BUTTON;
+    } else if (is_token(type, "FEAT_SPIKES")) {
+        return FEAT_SPIKES;
+    } else if (is_token(type, "FEAT_BREAKABLE_FLOOR")) {
+        return FEAT_BREAKABLE_FLOOR;
+    }
+    return FEAT_NONE;
+}
+
+static dir_t read_direction(const json_token_t *dir) {
+    if (is_token(dir, "x_plus")) {
+        return DIR_X_PLUS;
+    } else if (is_token(dir, "x_minus")) {
+        return DIR_X_MINUS;
+    } else if (is_token(dir, "z_plus")) {
+        return DIR_Z_PLUS;
+    } else if (is_token(dir, "z_minus")) {
+        return DIR_Z_MINUS;
+    }
+    return DIR_NONE;
+}
+
+static graphics_id_t read_graphics_id
+        (const json_token_t *name, const warp_map_t *graphics_ids) {
+    char buffer[MAX_NAME_LENGTH];
+    copy_token(name, buffer, MAX_NAME_LENGTH);
+
+    const void *id = warp_map_tag_get(graphics_ids, WARP_TAG(buffer));
+    if (id == nullptr) {
+        warp_log_e("Cannot find tile graphics with name: %s.", buffer);
+        return GRAPHICS_ID_INVALID;
+    }
+    return *(const graphics_id_t *)id;
+}
+
+/* reads {x, y, z} as well as {r, g, b} objects, missing members are zeroed */
+static vec3_t read_vec3(json_stream_t *stream) {
+    vec3_t result = vec3(0, 0, 0);
+    if (expect(stream, JTOK_OBJECT_BEGIN) == false) return result;
+
+    json_token_t key;
+    while (next_member(stream, &key)) {
+        if (is_token(&key, "x") || is_token(&key, "r")) {
+            result.x = read_number(stream);
+        } else if (is_token(&key, "y") || is_token(&key, "g")) {
+            result.y = read_number(stream);
+        } else if (is_token(&key, "z") || is_token(&key, "b")) {
+            result.z = read_number(stream);
+        } else {
+            skip_value(stream);
+        }
+    }
+    return result;
+}
+
+static void read_lighting(json_stream_t *stream, region_lighting_t *lighting) {
+    if (expect(stream, JTOK_OBJECT_BEGIN) == false) return;
+
+    json_token_t key;
+    while (next_member(stream, &key)) {
+        if (is_token(&key, "sunColor")) {
+            lighting->sun_color = read_vec3(stream);
+        } else if (is_token(&key, "sunDirection")) {
+            lighting->sun_direction = read_vec3(stream);
+        } else if (is_token(&key, "ambientColor")) {
+            lighting->ambient_color = read_vec3(stream);
+        } else {
+            skip_value(stream);
+        }
+    }
+}
+
+static void read_graphics(region_reader_t *reader) {
+    json_stream_t *stream = &reader->stream;
+    if (expect(stream, JTOK_ARRAY_BEGIN) == false) return;
+
+    while (next_element(stream)) {
+        if (expect(stream, JTOK_OBJECT_BEGIN) == false) return;
+
+        graphics_entry_t entry;
+        memset(&entry, 0, sizeof entry);
+
+        json_token_t key;
+        while (next_member(stream, &key)) {
+            if (is_token(&key, "name") && expect(stream, JTOK_STRING)) {
+                entry.name = stream->token;
+            } else if (is_token(&key, "mesh") && expect(stream, JTOK_STRING)) {
+                entry.mesh = stream->token;
+            } else if (is_token(&key, "texture") && expect(stream, JTOK_STRING)) {
+                entry.texture = stream->token;
+            } else {
+                skip_value(stream);
+            }
+        }
+
+        char buffer[MAX_NAME_LENGTH];
+        copy_token(&entry.name, buffer, MAX_NAME_LENGTH);
+        const graphics_id_t id = reader->graphics.size();
+        warp_map_tag_insert(&reader->source->graphics_ids, WARP_TAG(buffer), &id);
+        reader->graphics.push_back(entry);
+    }
+}
+
+static void read_tile
+        ( json_stream_t *stream, const warp_map_t *graphics_ids
+        , char *symbol, tile_t *tile
+        ) {
+    fill_default_tile(tile);
+    *symbol = '\0';
+    if (expect(stream, JTOK_OBJECT_BEGIN) == false) return;
+
+    const json_token_t *value = &stream->token;
+    json_token_t key;
+    while (next_member(stream, &key)) {
+        if (is_token(&key, "symbol") && expect(stream, JTOK_STRING)) {
+            char buffer[MAX_NAME_LENGTH];
+            copy_token(value, buffer, MAX_NAME_LENGTH);
+            *symbol = buffer[0];
+        } else if (is_token(&key, "walkable")) {
+            tile->is_walkable = read_boolean(stream);
+        } else if (is_token(&key, "stairs")) {
+            tile->is_stairs = read_boolean(stream);
+        } else if (is_token(&key, "object") && expect(stream, JTOK_STRING)) {
+            char buffer[MAX_NAME_LENGTH];
+            copy_token(value, buffer, MAX_NAME_LENGTH);
+            tile->object_id = WARP_TAG(buffer);
+        } else if (is_token(&key, "objectDirection") && expect(stream, JTOK_STRING)) {
+            tile->object_dir = read_direction(value);
+        } else if (is_token(&key, "feature") && expect(stream, JTOK_STRING)) {
+            tile->feature = read_feature(value);
+        } else if (is_token(&key, "spawnRate")) {
+            tile->spawn_probablity = read_number(stream);
+        } else if (is_token(&key, "target")) {
+            const vec3_t target = read_vec3(stream);
+            tile->feat_target_id = (size_t)target.x + LEVEL_WIDTH * (size_t)target.y;
+        } else if (is_token(&key, "portalId")) {
+            tile->portal_id = read_number(stream);
+        } else if (is_token(&key, "graphics") && expect(stream, JTOK_STRING)) {
+            tile->graphics_id = read_graphics_id(value, graphics_ids);
+        } else {
+            skip_value(stream);
+        }
+    }
+}
+
+/* like the document parser the first definition of a symbol wins */
+static void read_tiles
+        ( json_stream_t *stream, const warp_map_t *graphics_ids
+        , tile_t *tiles, bool *defined
+        ) {
+    if (expect(stream, JTOK_ARRAY_BEGIN) == false) return;
+
+    while (next_element(stream)) {
+        char symbol;
+        tile_t tile;
+        read_tile(stream, graphics_ids, &symbol, &tile);
+
+        const unsigned char index = symbol;
+        if (symbol != '\0' && defined[index] == false) {
+            tiles[index] = tile;
+            defined[index] = true;
+        }
+    }
+}
+
+static void read_decoration
+        (json_stream_t *stream, const warp_map_t *graphics_ids, decoration_t *d) {
+    transforms_init(&d->transforms);
+    d->graphics_id = GRAPHICS_ID_INVALID;
+    if (expect(stream, JTOK_OBJECT_BEGIN) == false) return;
+
+    vec3_t position = vec3(0, 0, 0);
+    vec3_t rotation = vec3(0, 0, 0);
+
+    json_token_t key;
+    while (next_member(stream, &key)) {
+        if (is_token(&key, "graphics") && expect(stream, JTOK_STRING)) {
+            d->graphics_id = read_graphics_id(&stream->token, graphics_ids);
+        } else if (is_token(&key, "position")) {
+            position = read_vec3(stream);
+        } else if (is_token(&key, "rotation")) {
+            rotation = read_vec3(stream);
+        } else {
+            skip_value(stream);
+        }
+    }
+
+    const quat_t rot = quat_from_euler(rotation.x, rotation.y, rotation.z);
+    transforms_change_position(&d->transforms, position);
+    transforms_change_rotation(&d->transforms, rot);
+}
+
+static void map_tiles
+        ( tile_t *tiles, const json_token_t *rows, size_t rows_count
+        , const region_reader_t *reader
+        ) {
+    for (size_t j = 0; j < LEVEL_HEIGHT; j++) {
+        for (size_t i = 0; i < LEVEL_WIDTH; i++) {
+            tile_t *tile = tiles + (i + LEVEL_WIDTH * j);
+            if (j >= rows_count || i >= rows[j].length) {
+                fill_default_tile(tile);
+                continue;
+            }
+
+            const unsigned char symbol = rows[j].start[i];
+            if (reader->local_defined[symbol]) {
+                *tile = reader->local_tiles[symbol];
+            } else if (reader->source->global_defined[symbol]) {
+                *tile = reader->source->global_tiles[symbol];
+            } else {
+                fill_default_tile(tile);
+            }
+        }
+    }
+}
+
+static level_t *read_level(region_reader_t *reader) {
+    json_stream_t *stream = &reader->stream;
+    if (expect(stream, JTOK_OBJECT_BEGIN) == false) return NULL;
+
+    memset(reader->local_defined, 0, sizeof reader->local_defined);
+    reader->decorations.clear();
+
+    /* rows point into the content, they are mapped once the whole level is
+     * read, as local tiles may follow the data; only escaped rows are
+     * decoded into a buffer */
+    json_token_t rows[LEVEL_HEIGHT];
+    char decoded_rows[LEVEL_HEIGHT][LEVEL_WIDTH + 1];
+    size_t rows_count = 0;
+
+    json_token_t key;
+    while (next_member(stream, &key)) {
+        if (is_token(&key, "tiles")) {
+            read_tiles( stream, &reader->source->graphics_ids
+                      , reader->local_tiles, reader->local_defined
+                      );
+        } else if (is_token(&key, "data") && expect(stream, JTOK_ARRAY_BEGIN)) {
+            while (next_element(stream)) {
+                if (expect(stream, JTOK_STRING) && rows_count < LEVEL_HEIGHT) {
+                    json_token_t *row = rows + rows_count;
+                    *row = stream->token;
+                    if (row->escaped) {
+                        char *decoded = decoded_rows[rows_count];
+                        copy_token(row, decoded, LEVEL_WIDTH + 1);
+                        row->start = decoded;
+                        row->length = strlen(decoded);
+                        row->escaped = false;
+                    }
+                    rows_count++;
+                } else {
+                    skip_value(stream);
+                }
+            }
+        } else if (is_token(&key, "decorations") && expect(stream, JTOK_ARRAY_BEGIN)) {
+            while (next_element(stream)) {
+                decoration_t decor;
+                read_decoration(stream, &reader->source->graphics_ids, &decor);
+                reader->decorations.push_back(decor);
+            }
+        } else {
+            skip_value(stream);
+        }
+    }
+
+    if (stream->failed) return NULL;
+
+    tile_t tiles[LEVEL_WIDTH * LEVEL_HEIGHT];
+    map_tiles(tiles, rows, rows_count, reader);
+
+    const size_t decors_count = reader->decorations.size();
+    const decoration_t *decors
+        = decors_count > 0 ? reader->decorations.data() : NULL;
+    return new level_t
+        (tiles, LEVEL_WIDTH, LEVEL_HEIGHT, decors, decors_count, reader->palette);
+}
+
+/* levels that do not fit the budget are only located, so they can be read
+ * when the region needs them */
+static void read_levels(region_reader_t *reader) {
+    json_stream_t *stream = &reader->stream;
+    if (expect(stream, JTOK_ARRAY_BEGIN) == false) return;
+
+    while (next_element(stream)) {
+        level_location_t location = { 0, 0 };
+        level_t *level = NULL;
+
+        const json_token_t *token = &stream->token;
+        if (token->type == JTOK_LITERAL && is_token(token, "null")) {
+            reader->levels.push_back(NULL);
+            reader->locations.push_back(location);
+            continue;
+        }
+
+        const char *start = token->start;
+        location.offset = start - reader->content;
+        const bool fits = reader->levels_budget == 0
+                       || reader->resident_bytes < reader->levels_budget;
+        if (fits) {
+            level = read_level(reader);
+            if (level != NULL) {
+                reader->resident_bytes += level->get_memory_size();
+            }
+        } else {
+            skip_value(stream);
+        }
+        location.length = stream->cursor - start;
+
+        reader->levels.push_back(level);
+        reader->locations.push_back(location);
+    }
+}
+
+static void read_portals(region_reader_t *reader) {
+    json_stream_t *stream = &reader->stream;
+    if (expect(stream, JTOK_ARRAY_BEGIN) == false) return;
+
+    while (next_element(stream)) {
+        if (expect(stream, JTOK_OBJECT_BEGIN) == false) return;
+
+        portal_entry_t entry;
+        memset(&entry, 0, sizeof entry);
+
+        json_token_t key;
+        while (next_member(stream, &key)) {
+            if (is_token(&key, "region") && expect(stream, JTOK_STRING)) {
+                entry.region = stream->token;
+            } else if (is_token(&key, "level")) {
+                entry.level = read_vec3(stream);
+            } else if (is_token(&key, "tile")) {
+                entry.tile = read_vec3(stream);
+            } else {
+                skip_value(stream);
+            }
+        }
+        reader->portals.push_back(entry);
+    }
+}
+
+static warp_result_t read_root(region_reader_t *reader) {
+    json_stream_t *stream = &reader->stream;
+    next_token(stream);
+    if (expect(stream, JTOK_OBJECT_BEGIN) == false) {
+        return warp_failure("Cannot read region: root element is not an object.");
+    }
+
+    json_token_t key;
+    while (next_member(stream, &key)) {
+        if (is_token(&key, "width")) {
+            reader->width = read_number(stream);
+        } else if (is_token(&key, "height")) {
+            reader->height = read_number(stream);
+        } else if (is_token(&key, "lighting")) {
+            /* read once the region exists, so defaults are kept */
+            reader->lighting = stream->token.start;
+            skip_value(stream);
+        } else if (is_token(&key, "graphics")) {
+            if (reader->tiles_read || reader->levels_read) {
+                return warp_failure("Cannot read region: 'graphics' must "
+                                    "precede 'tiles' and 'levels'.");
+            }
+            read_graphics(reader);
+            reader->graphics_read = true;
+        } else if (is_token(&key, "tiles")) {
+            if (reader->levels_read) {
+                return warp_failure("Cannot read region: 'tiles' must "
+                                    "precede 'levels'.");
+            }
+            region_source_t *source = reader->source;
+            read_tiles( stream, &source->graphics_ids
+                      , source->global_tiles, source->global_defined
+                      );
+            reader->tiles_read = true;
+        } else if (is_token(&key, "portals")) {
+            read_portals(reader);
+        } else if (is_token(&key, "levels")) {
+            read_levels(reader);
+            reader->levels_read = true;
+        } else {
+            skip_value(stream);
+        }
+    }
+
+    if (stream->failed) {
+        const char *position = stream->token.start;
+        return warp_failure( "Cannot read region: unexpected token '%.16s'."
+                           , position
+                           );
+    }
+    if (reader->levels.size() != reader->width * reader->height) {
+        return warp_failure( "Cannot read region: width, height and size of"
+                             " 'levels' are inconsitent."
+                           );
+    }
+    return warp_success();
+}
+
+static region_t *create_region(region_reader_t *reader) {
+    region_t *region = new region_t
+        (reader->levels.data(), reader->width, reader->height, reader->palette);
+    reader->levels.clear();
+    reader->palette = NULL;
+
+    if (warp_str_value(&reader->source->path)[0] != '\0') {
+        region->set_level_source
+            (reader->source, reader->locations.data(), reader->levels_budget);
+        reader->source = NULL;
+    }
+
+    char name[MAX_NAME_LENGTH];
+    for (const portal_entry_t &p : reader->portals) {
+        copy_token(&p.region, name, MAX_NAME_LENGTH);
+        region->add_portal( name, p.level.x, p.level.y, p.tile.x, p.tile.y);
+    }
+
+    char mesh[MAX_NAME_LENGTH];
+    char texture[MAX_NAME_LENGTH];
+    for (const graphics_entry_t &g : reader->graphics) {
+        copy_token(&g.name, name, MAX_NAME_LENGTH);
+        copy_token(&g.mesh, mesh, MAX_NAME_LENGTH);
+        copy_token(&g.texture, texture, MAX_NAME_LENGTH);
+        region->add_tile_graphics(WARP_TAG(name), mesh, texture);
+    }
+
+    if (reader->lighting != NULL) {
+        json_stream_t stream;
+        init_stream(&stream, reader->lighting);
+        next_token(&stream);
+
+        region_lighting_t lights = *region->get_region_lighting();
+        read_lighting(&stream, &lights);
+        region->set_lighting(&lights);
+    }
+
+    return region;
+}
+
+static size_t get_scratch_bytes(const region_reader_t *reader) {
+    return sizeof *reader
+         + reader->graphics.capacity() * sizeof (graphics_entry_t)
+         + reader->portals.capacity() * sizeof (portal_entry_t)
+         + reader->levels.capacity() * sizeof (level_t *)
+         + reader->locations.capacity() * sizeof (level_location_t)
+         + reader->decorations.capacity() * sizeof (decoration_t);
+}
+
+static region_source_t *create_region_source(const char *path) {
+    region_source_t *source = new region_source_t;
+    source->path = warp_str_create(path == NULL ? "" : path);
+    source->graphics_ids = warp_map_create_typed(graphics_id_t, NULL);
+    memset(source->global_defined, 0, sizeof source->global_defined);
+    return source;
+}
+
+extern void destroy_region_source(region_source_t *source) {
+    if (source == NULL) return;
+    warp_str_destroy(&source->path);
+    warp_map_destroy(&source->graphics_ids);
+    delete source;
+}
+
+static region_reader_t *create_reader
+        ( const char *content, region_source_t *source, tile_palette_t *palette
+        , size_t levels_budget
+        ) {
+    region_reader_t *reader = new region_reader_t;
+    init_stream(&reader->stream, content);
+    reader->content = content;
+    reader->source = source;
+    reader->palette = palette;
+    reader->levels_budget = levels_budget;
+    reader->resident_bytes = 0;
+    reader->width = 0;
+    reader->height = 0;
+    reader->lighting = NULL;
+    reader->graphics_read = false;
+    reader->tiles_read = false;
+    reader->levels_read = false;
+    memset(reader->local_defined, 0, sizeof reader->local_defined);
+    return reader;
+}
+
+extern warp_result_t read_region_stream
+        ( const char *content, const region_read_options_t *options
+        , region_t **region, region_read_stats_t *stats
+        ) {
+    if (content == NULL) {
+        return warp_failure("Cannot read region from null content.");
+    }
+    if (region == NULL) {
+        return warp_failure("Cannot read region into null output.");
+    }
+
+    const char *path = options == NULL ? NULL : options->path;
+    const size_t budget = path == NULL ? 0 : options->levels_budget;
+    region_source_t *source = create_region_source(path);
+    tile_palette_t *palette = new tile_palette_t;
+    region_reader_t *reader = create_reader(content, source, palette, budget);
+
+    *region = NULL;
+    warp_result_t result = read_root(reader);
+    if (WARP_FAILED(result)) {
+        for (level_t *level : reader->levels) {
+            delete level;
+        }
+        delete reader->palette;
+    } else {
+        *region = create_region(reader);
+    }
+
+    if (stats != NULL) {
+        stats->scratch_bytes = get_scratch_bytes(reader);
+    }
+
+    /* source is owned by the region when levels can be paged */
+    destroy_region_source(reader->source);
+    delete reader;
+
+    return result;
+}
+
+static bool read_file_part
+        (const char *path, const level_location_t *location, char *buffer) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) return false;
+
+    bool success = fseek(file, location->offset, SEEK_SET) == 0;
+    if (success) {
+        success = fread(buffer, 1, location->length, file) == location->length;
+    }
+    buffer[location->length] = '\0';
+
+    fclose(file);
+    return success;
+}
+
+extern warp_result_t read_level_from_source
+        ( const region_source_t *source, const level_location_t *location
+        , tile_palette_t *palette, level_t **level
+        ) {
+    if (source == NULL || location == NULL || location->length == 0) {
+        return warp_failure("Cannot read level, no source location.");
+    }
+    if (level == NULL) {
+        return warp_failure("Cannot read level into null output.");
+    }
+
+    const char *path = warp_str_value(&source->path);
+    char *content = new char[location->length + 1];
+    if (read_file_part(path, location, content) == false) {
+        delete [] content;
+        return warp_failure( "Cannot read level at %zu from region file: %s."
+                           , location->offset, path
+                           );
+    }
+
+    /* reader never modifies the source, it is only shared with the region */
+    region_reader_t *reader
+        = create_reader(content, (region_source_t *)source, palette, 0);
+    next_token(&reader->stream);
+    *level = read_level(reader);
+    delete reader;
+    delete [] content;
+
+    if (*level == NULL) {
+        return warp_failure("Cannot read level from region file: %s.", path);
+    }
+    return warp_success();
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "warp/utils/result.h"
+
+class region_t;
+class level_t;
+class tile_palette_t;
+
+/// Tiles palette and graphics names of a region, needed to read its levels
+/// after the region itself was read.
+struct region_source_t;
+
+/// Part of the region file describing single level.
+struct level_location_t {
+    size_t offset;
+    size_t length; /* zero for holes in the region grid */
+};
+
+struct region_read_options_t {
+    const char *path;     /* file the content was read from */
+    size_t levels_budget; /* levels over it are left for paging, zero means no limit */
+};
+
+struct region_read_stats_t {
+    size_t scratch_bytes; /* reader overhead, levels and tiles excluded */
+};
+
+/// Reads region from JSON text in a single pass over its tokens, filling
+/// tiles and decorations directly without building a document tree.
+/// Requires 'graphics' and 'tiles' members to precede 'levels'.
+/// Options may be null, then all levels are read and none can be paged.
+warp_result_t read_region_stream
+    ( const char *content, const region_read_options_t *options
+    , region_t **region, region_read_stats_t *stats
+    );
+
+/// Reads single level back from the region file.
+warp_result_t read_level_from_source
+    ( const region_source_t *source, const level_location_t *location
+    , tile_palette_t *palette, level_t **level
+    );
+
+void destroy_region_source(region_source_t *source);
@@ -0,0 +1,337 @@
+#define WARP_DROP_PREFIX
+#include "save_format.h"
+
+#include <cstring>
+
+#include "warp/utils/log.h"
+
+#include "level_state.h"
+#include "region.h"
+#include "facts.h"
+
+using namespace warp;
+
+static const char SAVE_MAGIC[4] = { 'T', 'A', 'U', 'S' };
+static const size_t HEADER_SIZE = 12; /* magic, version, payload size */
+static const size_t FACT_ENTRY_SIZE = 8;
+
+/* all numbers are stored little endian */
+
+static void put_u32(std::vector<char> *output, uint32_t value) {
+    for (size_t i = 0; i < 4; i++) {
+        output->push_back((char)(value >> (8 * i)));
+    }
+}
+
+static void put_u64(std::vector<char> *output, uint64_t value) {
+    put_u32(output, (uint32_t)value);
+    put_u32(output, (uint32_t)(value >> 32));
+}
+
+static void put_float(std::vector<char> *output, float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof bits);
+    put_u32(output, bits);
+}
+
+static void patch_u32(std::vector<char> *output, size_t offset, uint32_t value) {
+    for (size_t i = 0; i < 4; i++) {
+        (*output)[offset + i] = (char)(value >> (8 * i));
+    }
+}
+
+static uint32_t get_u32(const char *data) {
+    const unsigned char *bytes = (const unsigned char *)data;
+    return (uint32_t)bytes[0]
+         | (uint32_t)bytes[1] << 8
+         | (uint32_t)bytes[2] << 16
+         | (uint32_t)bytes[3] << 24;
+}
+
+static uint64_t get_u64(const char *data) {
+    return (uint64_t)get_u32(data) | (uint64_t)get_u32(data + 4) << 32;
+}
+
+static float get_float(const char *data) {
+    const uint32_t bits = get_u32(data);
+    float value;
+    memcpy(&value, &bits, sizeof value);
+    return value;
+}
+
+static void put_string(std::vector<char> *output, const char *value) {
+    const size_t length = value == NULL ? 0 : strlen(value);
+    put_u32(output, length);
+    output->insert(output->end(), value, value + length);
+    output->push_back('\0');
+}
+
+static void put_portal(std::vector<char> *output, const portal_t *portal) {
+    put_string(output, warp_str_value(&portal->region_name));
+    put_u64(output, portal->level_x);
+    put_u64(output, portal->level_z);
+    put_u64(output, portal->tile_x);
+    put_u64(output, portal->tile_z);
+}
+
+static void put_player(std::vector<char> *output, const object_t *player) {
+    put_u32(output, player->type != OBJ_NONE);
+    put_u32(output, player->health);
+    put_u32(output, player->max_health);
+    put_u32(output, player->ammo);
+    put_u32(output, player->flags);
+    put_u32(output, player->direction);
+    put_float(output, player->position.x);
+    put_float(output, player->position.y);
+    put_float(output, player->position.z);
+}
+
+extern void write_binary_save
+        ( std::vector<char> *output, const portal_t *portal
+        , const object_t *player, uint32_t seed, const fact_set_t *facts
+        , fact_names_t *names
+        ) {
+    const size_t start = output->size();
+    output->insert(output->end(), SAVE_MAGIC, SAVE_MAGIC + 4);
+    put_u32(output, SAVE_FORMAT_VERSION);
+    put_u32(output, 0); /* payload size, patched at the end */
+
+    put_portal(output, portal);
+    put_player(output, player);
+    put_u32(output, seed);
+
+    /* entries go first, so both passes over facts stream straight into
+     * the output, names follow in the same order */
+    const size_t counts_offset = output->size();
+    put_u32(output, 0);
+    put_u32(output, 0);
+
+    uint32_t count = 0;
+    uint32_t names_size = 0;
+    for (size_t i = 0; i < facts->count; i++) {
+        const int value = facts->values[i];
+        const char *name = value == 0 ? NULL : fact_names_get(names, i);
+        if (name == NULL) continue;
+        put_u32(output, names_size);
+        put_u32(output, value);
+        names_size += strlen(name) + 1;
+        count += 1;
+    }
+
+    for (size_t i = 0; i < facts->count; i++) {
+        const char *name = facts->values[i] == 0 ? NULL : fact_names_get(names, i);
+        if (name == NULL) continue;
+        output->insert(output->end(), name, name + strlen(name) + 1);
+    }
+
+    patch_u32(output, counts_offset, count);
+    patch_u32(output, counts_offset + 4, names_size);
+    patch_u32(output, start + 8, output->size() - start - HEADER_SIZE);
+}
+
+struct save_cursor_t {
+    const char *data;
+    size_t size;
+    size_t position;
+    bool failed;
+};
+
+static const char *take(save_cursor_t *cursor, size_t size) {
+    if (cursor->failed || cursor->size - cursor->position < size) {
+        cursor->failed = true;
+        return NULL;
+    }
+    const char *result = cursor->data + cursor->position;
+    cursor->position += size;
+    return result;
+}
+
+static uint32_t take_u32(save_cursor_t *cursor) {
+    const char *data = take(cursor, 4);
+    return data == NULL ? 0 : get_u32(data);
+}
+
+static uint64_t take_u64(save_cursor_t *cursor) {
+    const char *data = take(cursor, 8);
+    return data == NULL ? 0 : get_u64(data);
+}
+
+static float take_float(save_cursor_t *cursor) {
+    const char *data = take(cursor, 4);
+    return data == NULL ? 0 : get_float(data);
+}
+
+/* strings are stored with their terminator, it is checked so the view can
+ * point right into the data */
+static const char *take_string(save_cursor_t *cursor) {
+    const uint32_t length = take_u32(cursor);
+    const char *value = take(cursor, length + (size_t)1);
+    if (value != NULL && value[length] != '\0') {
+        cursor->failed = true;
+        return NULL;
+    }
+    return value;
+}
+
+static void take_portal(save_cursor_t *cursor, save_view_t *view) {
+    view->region_name = take_string(cursor);
+    view->level_x = take_u64(cursor);
+    view->level_z = take_u64(cursor);
+    view->tile_x = take_u64(cursor);
+    view->tile_z = take_u64(cursor);
+}
+
+static void take_player(save_cursor_t *cursor, save_view_t *view) {
+    view->has_player = take_u32(cursor) != 0;
+    view->health = take_u32(cursor);
+    view->max_health = take_u32(cursor);
+    view->ammo = take_u32(cursor);
+    view->flags = take_u32(cursor);
+    view->direction = take_u32(cursor);
+    for (size_t i = 0; i < 3; i++) {
+        view->position[i] = take_float(cursor);
+    }
+}
+
+extern bool read_binary_save(const char *data, size_t size, save_view_t *view) {
+    if (data == NULL || view == NULL) {
+        warp_log_e("Cannot read save, null data or view.");
+        return false;
+    }
+    if (size < HEADER_SIZE || memcmp(data, SAVE_MAGIC, 4) != 0) {
+        return false;
+    }
+
+    save_cursor_t cursor = { data, size, 4, false };
+    view->version = take_u32(&cursor);
+    if (view->version != SAVE_FORMAT_VERSION) {
+        warp_log_e("Unsupported save version: %u.", view->version);
+        return false;
+    }
+    const uint32_t payload_size = take_u32(&cursor);
+    if (payload_size > size - HEADER_SIZE) {
+        warp_log_e("Save is truncated.");
+        return false;
+    }
+    cursor.size = HEADER_SIZE + payload_size;
+
+    take_portal(&cursor, view);
+    take_player(&cursor, view);
+
+    view->seed = take_u32(&cursor);
+
+    view->facts_count = take_u32(&cursor);
+    view->fact_names_size = take_u32(&cursor);
+    if (view->facts_count > payload_size / FACT_ENTRY_SIZE) {
+        cursor.failed = true;
+    } else {
+        view->fact_entries = take(&cursor, view->facts_count * FACT_ENTRY_SIZE);
+    }
+    view->fact_names = take(&cursor, view->fact_names_size);
+
+    if (cursor.failed) {
+        warp_log_e("Save is malformed.");
+        return false;
+    }
+    if (view->fact_names_size > 0 
+            && view->fact_names[view->fact_names_size - 1] != '\0') {
+        warp_log_e("Save contains unterminated names.");
+        return false;
+    }
+    return true;
+}
+
+extern bool get_save_view_fact
+        (const save_view_t *view, size_t index, const char **name, int *value) {
+    if (index >= view->facts_count) return false;
+
+    const char *entry = view->fact_entries + index * FACT_ENTRY_SIZE;
+    const uint32_t offset = get_u32(entry);
+    if (offset >= view->fact_names_size) return false;
+
+    *name = view->fact_names + offset;
+    *value = (int32_t)get_u32(entry + 4);
+    return true;
+}
+
+static const char JOURNAL_MAGIC[4] = { 'T', 'A', 'U', 'J' };
+static const size_t JOURNAL_HEADER_SIZE = 8; /* magic, version */
+
+extern void write_journal_header(std::vector<char> *output) {
+    output->insert(output->end(), JOURNAL_MAGIC, JOURNAL_MAGIC + 4);
+    put_u32(output, SAVE_FORMAT_VERSION);
+}
+
+extern void write_journal_fact
+        (std::vector<char> *output, const char *fact, int value) {
+    output->push_back(JOURNAL_FACT);
+    put_string(output, fact);
+    put_u32(output, value);
+}
+
+extern void write_journal_player(std::vector<char> *output, const object_t *player) {
+    output->push_back(JOURNAL_PLAYER);
+    put_player(output, player);
+}
+
+extern void write_journal_portal(std::vector<char> *output, const portal_t *portal) {
+    output->push_back(JOURNAL_PORTAL);
+    put_portal(output, portal);
+}
+
+extern void write_journal_seed(std::vector<char> *output, uint32_t seed) {
+    output->push_back(JOURNAL_SEED);
+    put_u32(output, seed);
+}
+
+extern bool read_journal_record
+        ( const char *data, size_t size, size_t *offset
+        , journal_record_t *record
+        ) {
+    if (*offset == 0) {
+        if (size < JOURNAL_HEADER_SIZE || memcmp(data, JOURNAL_MAGIC, 4) != 0) {
+            warp_log_e("Save journal has invalid header.");
+            return false;
+        }
+        const uint32_t version = get_u32(data + 4);
+        if (version != SAVE_FORMAT_VERSION) {
+            warp_log_e("Unsupported save journal version: %u.", version);
+            return false;
+        }
+        *offset = JOURNAL_HEADER_SIZE;
+    }
+    /* zero kind ends the journal, file contents may be zero terminated */
+    if (*offset >= size || data[*offset] == '\0') return false;
+
+    save_cursor_t cursor = { data, size, *offset, false };
+    const char *kind = take(&cursor, 1);
+    record->kind = (journal_record_kind_t)*kind;
+
+    save_view_t *view = &record->view;
+    switch (record->kind) {
+        case JOURNAL_FACT:
+            record->fact = take_string(&cursor);
+            record->value = (int32_t)take_u32(&cursor);
+            break;
+        case JOURNAL_PLAYER:
+            take_player(&cursor, view);
+            break;
+        case JOURNAL_PORTAL:
+            take_portal(&cursor, view);
+            break;
+        case JOURNAL_SEED:
+            view->seed = take_u32(&cursor);
+            break;
+        default:
+            cursor.failed = true;
+            break;
+    }
+
+    if (cursor.failed) {
+        /* most likely the game stopped in the middle of an append */
+        warp_log_e("Save journal is cut at byte %zu, rest is ignored.", *offset);
+        return false;
+    }
+    *offset = cursor.position;
+    return true;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+struct object_t;
+struct portal_t;
+
+typedef struct fact_set fact_set_t;
+typedef struct fact_names fact_names_t;
+
+#define SAVE_FORMAT_VERSION 1
+
+/// Binary save read in place, strings point into the buffer it was read
+/// from, so the buffer has to outlive the view.
+struct save_view_t {
+    uint32_t version;
+
+    const char *region_name;
+    uint64_t level_x, level_z;
+    uint64_t tile_x, tile_z;
+
+    bool has_player;
+    int32_t health;
+    int32_t max_health;
+    int32_t ammo;
+    uint32_t flags;
+    uint32_t direction;
+    float position[3];
+
+    uint32_t seed;
+
+    size_t facts_count;
+    const char *fact_entries; /* pairs of name offset and value */
+    const char *fact_names;   /* NUL terminated names */
+    size_t fact_names_size;
+};
+
+/// Appends binary save to output, facts are written as a table of names
+/// referenced by offset, the names are looked up in names. Facts equal to
+/// zero are left out.
+void write_binary_save
+    ( std::vector<char> *output, const portal_t *portal
+    , const object_t *player, uint32_t seed, const fact_set_t *facts
+    , fact_names_t *names
+    );
+
+/// Checks header and bounds of the save, does not copy anything.
+bool read_binary_save(const char *data, size_t size, save_view_t *view);
+
+bool get_save_view_fact
+    (const save_view_t *view, size_t index, const char **name, int *value);
+
+enum journal_record_kind_t : uint8_t {
+    JOURNAL_FACT = 1,
+    JOURNAL_PLAYER,
+    JOURNAL_PORTAL,
+    JOURNAL_SEED,
+};
+
+/// Single change read from the journal. Records hold whole new values, so
+/// replaying a record that is already part of the save changes nothing.
+struct journal_record_t {
+    journal_record_kind_t kind;
+    const char *fact;  /* fact records */
+    int value;
+    save_view_t view;  /* player, portal and seed records */
+};
+
+/// Journal starts with a header, records are appended after it.
+void write_journal_header(std::vector<char> *output);
+void write_journal_fact(std::vector<char> *output, const char *fact, int value);
+void write_journal_player(std::vector<char> *output, const object_t *player);
+void write_journal_portal(std::vector<char> *output, const portal_t *portal);
+void write_journal_seed(std::vector<char> *output, uint32_t seed);
+
+/// Reads record at offset and moves offset past it, offset of zero reads
+/// the header first. Returns false at the end, on a zero byte and on a cut
+/// record.
+bool read_journal_record
+    ( const char *data, size_t size, size_t *offset
+    , journal_record_t *record
+    );
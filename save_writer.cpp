@@ -0,0 +1,214 @@
+#define WARP_DROP_PREFIX
+#include "save_writer.h"
+
+#include <stdio.h> /* rename, remove */
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#include "warp/utils/io.h"
+#include "warp/utils/log.h"
+
+using namespace warp;
+
+static double elapsed_ms(std::chrono::steady_clock::time_point start) {
+    const auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+static bool write_atomically(const std::string &path, const std::vector<char> &data) {
+    const std::string temp_path = path + ".tmp";
+
+    warp_result_t save_result = save_file(temp_path.c_str(), data.data(), data.size());
+    if (WARP_FAILED(save_result)) {
+        warp_result_log("Failed to save game", &save_result);
+        warp_result_destory(&save_result);
+        return false;
+    }
+
+    if (rename(temp_path.c_str(), path.c_str()) != 0) {
+        /* some platforms refuse to rename over an existing file */
+        remove(path.c_str());
+        if (rename(temp_path.c_str(), path.c_str()) != 0) {
+            warp_log_e("Failed to replace game save: %s.", path.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool append_to_file(const std::string &path, const std::vector<char> &data) {
+    FILE *file = fopen(path.c_str(), "ab");
+    if (file == NULL) {
+        warp_log_e("Failed to open save journal: %s.", path.c_str());
+        return false;
+    }
+    const size_t written = fwrite(data.data(), 1, data.size(), file);
+    const bool closed = fclose(file) == 0;
+    if (written != data.size() || closed == false) {
+        warp_log_e("Failed to append to save journal: %s.", path.c_str());
+        return false;
+    }
+    return true;
+}
+
+struct save_job_t {
+    bool append;
+    std::string path;
+    std::vector<char> data;
+};
+
+class save_writer_t {
+    public:
+        save_writer_t()
+                : _running(false)
+                , _writing(false)
+                , _pending()
+                , _stats()
+                , _mutex()
+                , _wake()
+                , _done()
+                , _thread() {
+        }
+
+        ~save_writer_t() {
+            flush();
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if (_running == false) return;
+                _running = false;
+            }
+            _wake.notify_one();
+            _thread.join();
+        }
+
+        void submit(const char *path, const char *data, size_t size, bool append) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_running == false) {
+                _running = true;
+                _thread = std::thread(&save_writer_t::run, this);
+            }
+            _stats.submitted_count += 1;
+
+            /* pending job keeps its place in the queue, so it stays ordered
+             * with the jobs submitted after it; the save can only take the
+             * place of the latest job for the path, or appends queued after
+             * that job would be written over this save */
+            if (append == false) {
+                save_job_t *latest = find_latest(path);
+                if (latest != NULL && latest->append == false) {
+                    latest->data.assign(data, data + size);
+                    _stats.coalesced_count += 1;
+                    return;
+                }
+            }
+            if (append && _pending.empty() == false) {
+                save_job_t &last = _pending.back();
+                if (last.append && last.path == path) {
+                    last.data.insert(last.data.end(), data, data + size);
+                    _stats.coalesced_count += 1;
+                    return;
+                }
+            }
+
+            save_job_t job;
+            job.append = append;
+            job.path = path;
+            job.data.assign(data, data + size);
+            _pending.push_back(job);
+
+            _wake.notify_one();
+        }
+
+        void flush() {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _done.wait(lock, [this]() { return _pending.empty() && _writing == false; });
+        }
+
+        save_writer_stats_t get_stats() {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return _stats;
+        }
+
+    private:
+        save_job_t *find_latest(const char *path) {
+            for (auto it = _pending.rbegin(); it != _pending.rend(); it++) {
+                if (it->path == path) return &*it;
+            }
+            return NULL;
+        }
+
+        void run() {
+            save_job_t job;
+
+            std::unique_lock<std::mutex> lock(_mutex);
+            while (true) {
+                _wake.wait(lock, [this]() { return _running == false || _pending.empty() == false; });
+                if (_pending.empty()) break;
+
+                job = std::move(_pending.front());
+                _pending.pop_front();
+                _writing = true;
+                lock.unlock();
+
+                const auto start = std::chrono::steady_clock::now();
+                const bool written = job.append 
+                                   ? append_to_file(job.path, job.data)
+                                   : write_atomically(job.path, job.data);
+                const double time = elapsed_ms(start);
+
+                lock.lock();
+                _writing = false;
+                _stats.written_count += written ? 1 : 0;
+                _stats.failed_count += written ? 0 : 1;
+                _stats.last_write_ms = time;
+                _stats.total_write_ms += time;
+                if (time > _stats.max_write_ms) {
+                    _stats.max_write_ms = time;
+                }
+                _done.notify_all();
+            }
+        }
+
+    private:
+        bool _running;
+        bool _writing;
+
+        std::deque<save_job_t> _pending;
+        save_writer_stats_t _stats;
+
+        std::mutex _mutex;
+        std::condition_variable _wake;
+        std::condition_variable _done;
+        std::thread _thread;
+};
+
+static save_writer_t writer;
+
+extern void submit_save(const char *path, const char *data, size_t size) {
+    if (path == NULL || data == NULL) {
+        warp_log_e("Cannot submit save, null path or data.");
+        return;
+    }
+    writer.submit(path, data, size, false);
+}
+
+extern void submit_save_append(const char *path, const char *data, size_t size) {
+    if (path == NULL || data == NULL) {
+        warp_log_e("Cannot submit save append, null path or data.");
+        return;
+    }
+    writer.submit(path, data, size, true);
+}
+
+extern void flush_saves() {
+    writer.flush();
+}
+
+extern save_writer_stats_t get_save_writer_stats() {
+    return writer.get_stats();
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stddef.h>
+
+struct save_writer_stats_t {
+    size_t submitted_count;
+    size_t written_count;
+    size_t coalesced_count;  /* saves merged with pending ones before writing */
+    size_t failed_count;
+    double last_write_ms;
+    double max_write_ms;
+    double total_write_ms;
+};
+
+/// Hands serialized save to the background writer thread, never waits for
+/// the disk. Save replaces any older one that is not written yet. Files
+/// are written to a temporary file first and then renamed over the path.
+void submit_save(const char *path, const char *data, size_t size);
+
+/// Appends data to the file on the writer thread. Appends and saves are
+/// written in the order they were submitted.
+void submit_save_append(const char *path, const char *data, size_t size);
+
+/// Blocks until all submitted saves are written.
+void flush_saves();
+
+save_writer_stats_t get_save_writer_stats();
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "warp/components.h"
+
+#include "perf.h"
+
+/* Most controllers only animate for a moment after a message and spend
+ * other frames returning from update. Sleeping controllers skip their
+ * update until a handler calls wake() or the time passed to sleep_for()
+ * runs out. Controllers start awake, so their idle state is applied once. */
+class sleeping_controller_t : public warp::controller_impl_i {
+    public:
+        void update(float dt, const warp::input_t &input) final override {
+            if (_awake == false) {
+                PERF_ADD(PERF_CONTROLLERS_ASLEEP, 1);
+                if (_wake_timer <= 0) return;
+                _wake_timer -= dt;
+                if (_wake_timer > 0) return;
+                _awake = true;
+            }
+            PERF_ADD(PERF_CONTROLLER_UPDATES, 1);
+            update_awake(dt, input);
+        }
+
+    protected:
+        sleeping_controller_t()
+            : _awake(true)
+            , _wake_timer(0)
+        {}
+
+        virtual void update_awake(float dt, const warp::input_t &input) = 0;
+
+        void wake() {
+            _awake = true;
+            _wake_timer = 0;
+        }
+
+        void sleep() {
+            _awake = false;
+            _wake_timer = 0;
+        }
+
+        void sleep_for(float seconds) {
+            _awake = false;
+            _wake_timer = seconds;
+        }
+
+    private:
+        bool _awake;
+        float _wake_timer;
+};
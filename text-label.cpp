@@ -1,6 +1,9 @@
 #define WARP_DROP_PREFIX
 #include "text-label.h"
 
+#include <cstring>
+#include <vector>
+
 #include "warp/math/utils.h"
 #include "warp/math/mat4.h"
 #include "warp/world.h"
@@ -10,6 +13,10 @@
 #include "warp/graphics/texture-loader.h"
 
 #include "core.h"
+#include "entities.h"
+#include "trace.h"
+#include "sleeping_controller.h"
+#include "tweens.h"
 
 using namespace warp;
 
@@ -31,8 +38,15 @@ extern warp_res_id_t get_dialog_font(resources_t *res) {
 }
 
 static int label_mesh_id = 0;
+static size_t tessellations_count = 0;
+
+extern size_t take_label_tessellations_count() {
+    const size_t count = tessellations_count;
+    tessellations_count = 0;
+    return count;
+}
 
-class label_controller_t final : public controller_impl_i {
+class label_controller_t final : public sleeping_controller_t {
     public:
         label_controller_t
             (const res_id_t font, float scale, warp_font_alignment_t align)
@@ -40,8 +54,14 @@ class label_controller_t final : public controller_impl_i {
               , _align(align)
               , _scale(scale)
               , _mesh_id(0)
+              , _text()
+              , _vertices()
         {}
 
+        ~label_controller_t() {
+            warp_str_destroy(&_text);
+        }
+
         dynval_t get_property(const warp_tag_t &) const override {
             return dynval_t::make_null();
         }
@@ -51,7 +71,10 @@ class label_controller_t final : public controller_impl_i {
             _world = world;
         }
 
-        void update(float, const input_t &) override { }
+        /* labels change only on messages */
+        void update_awake(float, const input_t &) override {
+            sleep();
+        }
 
         void handle_message(const message_t &message) override {
             messagetype_t type = message.type;
@@ -68,22 +91,37 @@ class label_controller_t final : public controller_impl_i {
         }
 
         void recreate_text_mesh(const char *str) {
+            if (str == NULL) {
+                str = "";
+            }
+            /* most updates repeat the text that is already shown */
+            if (_mesh_id != 0 && strcmp(str, warp_str_value(&_text)) == 0) {
+                return;
+            }
+
+            TRACE_SCOPE("label tessellation");
             resources_t *res = _world->get_resources();
             const font_t *font = resources_get_font(res, _font);
-            warp_str_t text = WARP_STR(str);
-            const size_t count = warp_font_tesslated_buffer_size(font, &text);
-            vertex_t *vertices = (vertex_t *)malloc(count * sizeof *vertices);
+            warp_str_destroy(&_text);
+            _text = WARP_STR(str);
 
-            warp_font_tesselate(font, vertices, count, &text, _align);
-            warp_str_destroy(&text);
-            
+            const size_t count = warp_font_tesslated_buffer_size(font, &_text);
+            if (_vertices.size() < count) {
+                _vertices.resize(count);
+            }
+            vertex_t *vertices = _vertices.data();
+            warp_font_tesselate(font, vertices, count, &_text, _align);
+            tessellations_count += 1;
+            show_vertices(vertices, count);
+        }
+
+        /* shows text tessellated elsewhere with the same font */
+        void show_vertices(const vertex_t *vertices, size_t count) {
             if (_mesh_id == 0) {
                 add_new_mesh(vertices, count);
             } else {
                 mutate_mesh(vertices, count);
             }
-
-            free(vertices);
         }
 
 
@@ -98,7 +136,10 @@ class label_controller_t final : public controller_impl_i {
         res_id_t _mesh_id;
         model_t *_model;
 
-        void add_new_mesh(vertex_t *vertices, size_t count) {
+        warp_str_t _text;                /* shown text, compared on updates */
+        std::vector<vertex_t> _vertices; /* only grows */
+
+        void add_new_mesh(const vertex_t *vertices, size_t count) {
             resources_t *res = _world->get_resources();
             const font_t *font = resources_get_font(res, _font);
 
@@ -123,7 +164,7 @@ class label_controller_t final : public controller_impl_i {
             _owner->receive_message(MSG_PHYSICS_MOVE, _owner->get_position());
         }
 
-        void mutate_mesh(vertex_t *vertices, size_t count) {
+        void mutate_mesh(const vertex_t *vertices, size_t count) {
             resources_t *res = _world->get_resources();
             warp_mesh_resource_mutate(res, _mesh_id, vertices, count);
         }
@@ -171,26 +212,35 @@ extern entity_t *create_label(world_t *world, res_id_t font_id, label_flags_t fl
     controller_comp_t *controller = world->create_controller();
     controller->initialize(new label_controller_t(font_id, 1, align));
 
-    return world->create_entity(position, graphics, nullptr, controller);
+    return create_game_entity(world, position, graphics, nullptr, controller);
 }
 
 /* TODO: move outside this module */
 
-enum shrink_state_t {
-    SHRINK_GROWING,
-    SHRINK_STABLE,
-    SHRINK_SHRINKING,
-};
+static const float SHRINK_GROWING_TIME   = 2.50f;
+static const float SHRINK_STABLE_TIME    = 0.25f;
+static const float SHRINK_SHRINKING_TIME = 2.00f;
+static const float SHRINK_LIFETIME
+    = SHRINK_GROWING_TIME + SHRINK_STABLE_TIME + SHRINK_SHRINKING_TIME;
 
+/* each stage of the animation starts the next one when done */
 class shrink_controller_t final : public controller_impl_i {
     public:
-        shrink_controller_t()
+        /* recycled owner is hidden instead of destroyed when finished */
+        shrink_controller_t(bool recycle)
             : _owner(nullptr)
             , _world(nullptr)
-            , _timer(0)
-            , _state(SHRINK_GROWING)
+            , _tweens()
+            , _recycle(recycle)
+            , _finished(false)
         { }
 
+        ~shrink_controller_t() {
+            if (_tweens != nullptr) {
+                _tweens->stop(_owner, TWEEN_SCALE);
+            }
+        }
+
         dynval_t get_property(const warp_tag_t &) const override {
             return dynval_t::make_null();
         }
@@ -198,76 +248,81 @@ class shrink_controller_t final : public controller_impl_i {
         void initialize(entity_t *owner, world_t *world) override {
             _owner = owner;
             _world = world;
+            _tweens = get_tweens(world)->shared_from_this();
 
-            change_state(SHRINK_GROWING);
+            grow();
         }
 
-        void update(float dt, const input_t &) override { 
-            if (_timer <= 0) {
-                if (_state == SHRINK_GROWING) {
-                    change_state(SHRINK_STABLE);
-                } else if (_state == SHRINK_STABLE) {
-                    change_state(SHRINK_SHRINKING);
-                } else if (_state == SHRINK_SHRINKING) {
-                    _world->destroy_later(_owner);
-                } 
-                return;
-            } 
+        void update(float, const input_t &) override { }
 
-            _timer -= dt;
-            const float t = _timer / get_time_for_state(_state);
+        void handle_message(const message_t &) override { }
 
-            if (_state == SHRINK_SHRINKING) {
-                update_dying(t);
-            } else if (_state == SHRINK_GROWING) {
-                update_rising(t);
-            }
-        }
+        bool is_finished() const { return _finished; }
 
-        void handle_message(const message_t &) override { }
+        void restart() {
+            _finished = false;
+            grow();
+            _owner->receive_message(MSG_GRAPHICS_VISIBLITY, 1);
+        }
 
     private:
         entity_t *_owner;
         world_t *_world;
-        float _timer;
-        shrink_state_t _state;
-
-        void change_state(shrink_state_t state) {
-            _state = state;
-            _timer = get_time_for_state(state);
+        std::shared_ptr<tween_system_t> _tweens;
+        bool _recycle;
+        bool _finished;
+
+        void grow() {
+            const tween_def_t def =
+                { TWEEN_SCALE, TWEEN_ELASTIC, TWEEN_ELASTIC
+                , vec3(0, 0, 0), vec3(1, 1, 1), SHRINK_GROWING_TIME
+                };
+            _tweens->start(_owner, def, [this]() { stay(); });
         }
 
-        float get_time_for_state(shrink_state_t state) {
-            switch (state) {
-                case SHRINK_GROWING:   return 2.50f;
-                case SHRINK_STABLE:    return 0.25f;
-                case SHRINK_SHRINKING: return 2.00f;
-                default: return 0;
-            }
+        void stay() {
+            const tween_def_t def =
+                { TWEEN_SCALE, TWEEN_LINEAR, TWEEN_LINEAR
+                , vec3(1, 1, 1), vec3(1, 1, 1), SHRINK_STABLE_TIME
+                };
+            _tweens->start(_owner, def, [this]() { shrink(); });
         }
 
-        void update_dying(float t) {
-            const float scale = ease_cubic(t);
-            const vec3_t scales = vec3(scale, scale, scale);
-            _owner->receive_message(MSG_PHYSICS_SCALE, scales);
+        void shrink() {
+            const tween_def_t def =
+                { TWEEN_SCALE, TWEEN_CUBIC_OUT, TWEEN_CUBIC_OUT
+                , vec3(1, 1, 1), vec3(0, 0, 0), SHRINK_SHRINKING_TIME
+                };
+            _tweens->start(_owner, def, [this]() { finish(); });
         }
 
-        void update_rising(float t) {
-            const float scale = ease_elastic(1 - t);
-            const vec3_t scales = vec3(scale, scale, scale);
-            _owner->receive_message(MSG_PHYSICS_SCALE, scales);
+        void finish() {
+            _finished = true;
+            if (_recycle) {
+                _owner->receive_message(MSG_GRAPHICS_VISIBLITY, 0);
+            } else {
+                destroy_game_entity(_world, _owner);
+            }
         }
 };
 
+/* rises by height, slowing down to a stop at the end of duration */
 class ballon_controller_t final : public controller_impl_i {
     public:
-        ballon_controller_t(float velocity, float acceleration)
+        ballon_controller_t(float height, float duration)
             : _owner(nullptr)
             , _world(nullptr)
-            , _velocity(velocity)
-            , _acceleration(acceleration)
+            , _tweens()
+            , _height(height)
+            , _duration(duration)
         { }
 
+        ~ballon_controller_t() {
+            if (_tweens != nullptr) {
+                _tweens->stop(_owner, TWEEN_POSITION);
+            }
+        }
+
         dynval_t get_property(const warp_tag_t &) const override {
             return dynval_t::make_null();
         }
@@ -275,30 +330,85 @@ class ballon_controller_t final : public controller_impl_i {
         void initialize(entity_t *owner, world_t *world) override {
             _owner = owner;
             _world = world;
-        }
+            _tweens = get_tweens(world)->shared_from_this();
 
-        void update(float dt, const input_t &) override { 
-            _velocity += dt * _acceleration;
-            const vec3_t pos
-                = vec3_add(_owner->get_position(), vec3(0, dt * _velocity, 0));
-            _owner->receive_message(MSG_PHYSICS_MOVE, pos);
+            restart(_owner->get_position());
         }
 
+        void update(float, const input_t &) override { }
+
         void handle_message(const message_t &) override { }
 
+        void restart(vec3_t position) {
+            const tween_def_t def =
+                { TWEEN_POSITION, TWEEN_QUAD_OUT, TWEEN_QUAD_OUT
+                , position, vec3_add(position, vec3(0, _height, 0)), _duration
+                };
+            _tweens->start(_owner, def);
+        }
+
     private:
         entity_t *_owner;
         world_t *_world;
-        float _velocity;
-        float _acceleration;
+        std::shared_ptr<tween_system_t> _tweens;
+        float _height;
+        float _duration;
 };
 
-extern entity_t *create_speech_bubble
-        (world_t *world, res_id_t font, vec3_t position, const char *text) {
-    warp_font_alignment_t align = WARP_FONT_ALIGN_CENTER;
+struct speech_bubble_t {
+    entity_t *entity;
+    label_controller_t *label;
+    shrink_controller_t *shrink;
+    ballon_controller_t *ballon;
+    const std::vector<vertex_t> *shown;
+};
 
-    graphics_comp_t *graphics = world->create_graphics();
-    resources_t *res = world->get_resources();
+/* texts are never evicted one by one, the whole cache is dropped when full */
+static const size_t MAX_CACHED_TEXTS = 64;
+
+speech_bubble_pool_t::speech_bubble_pool_t(world_t *world, res_id_t font)
+        : _world(world)
+        , _font(font)
+        , _bubbles()
+        , _texts() {
+}
+
+speech_bubble_pool_t::~speech_bubble_pool_t() {
+    /* entities and controllers are owned by the world */
+    for (speech_bubble_t *bubble : _bubbles) {
+        delete bubble;
+    }
+}
+
+const std::vector<vertex_t> *speech_bubble_pool_t::get_text(const char *text) {
+    auto found = _texts.find(text);
+    if (found != _texts.end()) {
+        return &found->second;
+    }
+
+    if (_texts.size() >= MAX_CACHED_TEXTS) {
+        _texts.clear();
+        for (speech_bubble_t *bubble : _bubbles) {
+            bubble->shown = NULL;
+        }
+    }
+
+    TRACE_SCOPE("label tessellation");
+    const font_t *font = resources_get_font(_world->get_resources(), _font);
+    warp_str_t str = WARP_STR(text);
+    std::vector<vertex_t> &vertices = _texts[text];
+    vertices.resize(warp_font_tesslated_buffer_size(font, &str));
+    warp_font_tesselate
+        (font, vertices.data(), vertices.size(), &str, WARP_FONT_ALIGN_CENTER);
+    tessellations_count += 1;
+    warp_str_destroy(&str);
+
+    return &vertices;
+}
+
+speech_bubble_t *speech_bubble_pool_t::create_bubble(vec3_t position) {
+    graphics_comp_t *graphics = _world->create_graphics();
+    resources_t *res = _world->get_resources();
     const res_id_t mesh_id = resources_load(res, "speech.obj");
     const res_id_t tex_id = resources_load(res, "blank.png");
     float trans[16]; mat4_fill_translation(trans, vec3(0, 0, -0.05f));
@@ -307,19 +417,48 @@ extern entity_t *create_speech_bubble
     model_change_local_transforms(&model, trans);
     graphics->add_model(model);
 
-    controller_comp_t *controller = world->create_controller();
-    
-    label_controller_t *label_ctrl = new label_controller_t(font, 0.008f, align);
-    controller->initialize(label_ctrl);
-    controller->add_controller(new shrink_controller_t);
-    controller->add_controller(new ballon_controller_t(0.5f, -0.1f));
+    speech_bubble_t *bubble = new speech_bubble_t;
+    bubble->label = new label_controller_t(_font, 0.008f, WARP_FONT_ALIGN_CENTER);
+    bubble->shrink = new shrink_controller_t(true);
+    /* rises about as high as it did at 0.5 per second, slowed by 0.1 */
+    bubble->ballon = new ballon_controller_t(1.25f, SHRINK_LIFETIME);
+    bubble->shown = NULL;
 
-    entity_t *entity
-        = world->create_entity(position, graphics, nullptr, controller);
+    controller_comp_t *controller = _world->create_controller();
+    controller->initialize(bubble->label);
+    controller->add_controller(bubble->shrink);
+    controller->add_controller(bubble->ballon);
 
-    label_ctrl->recreate_text_mesh(text);
+    bubble->entity
+        = create_game_entity(_world, position, graphics, nullptr, controller);
+    bubble->entity->receive_message(MSG_PHYSICS_ROTATE, quat_from_euler(0, 0, 0.3f));
 
-    entity->receive_message(MSG_PHYSICS_ROTATE, quat_from_euler(0, 0, 0.3f));
+    _bubbles.push_back(bubble);
+    return bubble;
+}
+
+entity_t *speech_bubble_pool_t::emit(vec3_t position, const char *text) {
+    speech_bubble_t *bubble = NULL;
+    for (speech_bubble_t *pooled : _bubbles) {
+        if (pooled->shrink->is_finished()) {
+            bubble = pooled;
+            break;
+        }
+    }
+
+    if (bubble == NULL) {
+        bubble = create_bubble(position);
+    } else {
+        bubble->shrink->restart();
+        bubble->entity->receive_message(MSG_PHYSICS_MOVE, position);
+        bubble->ballon->restart(position);
+    }
+
+    const std::vector<vertex_t> *vertices = get_text(text);
+    if (bubble->shown != vertices) {
+        bubble->label->show_vertices(vertices->data(), vertices->size());
+        bubble->shown = vertices;
+    }
 
-    return entity;
+    return bubble->entity;
 }
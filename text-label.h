@@ -1,5 +1,9 @@
 #pragma once
 
+#include <vector>
+#include <string>
+#include <unordered_map>
+
 #include "warp/helpers.h"
 #include "warp/graphics/font.h"
 
@@ -27,10 +31,31 @@ WARP_ENABLE_FLAGS(label_flags_t);
 warp_res_id_t get_default_font(warp_resources_t *res);
 warp_res_id_t get_dialog_font(warp_resources_t *res);
 
+/* Number of label texts tessellated since the last call: */
+size_t take_label_tessellations_count();
+
 warp::entity_t * create_label
     (warp::world_t *world, warp_res_id_t font, label_flags_t flags);
 
-warp::entity_t *create_speech_bubble
-    ( warp::world_t *world, warp_res_id_t font
-    , warp_vec3_t pos, const char *text
-    );
+struct speech_bubble_t;
+
+/* Recycles speech bubbles once they shrink away. Each pooled bubble keeps
+ * its own text mesh, and tessellated texts are cached, since the same few
+ * strings repeat: */
+class speech_bubble_pool_t {
+    public:
+        speech_bubble_pool_t(warp::world_t *world, warp_res_id_t font);
+        ~speech_bubble_pool_t();
+
+        warp::entity_t *emit(warp_vec3_t pos, const char *text);
+
+    private:
+        speech_bubble_t *create_bubble(warp_vec3_t pos);
+        const std::vector<warp_vertex_t> *get_text(const char *text);
+
+    private:
+        warp::world_t *_world;
+        warp_res_id_t _font;
+        std::vector<speech_bubble_t *> _bubbles;
+        std::unordered_map<std::string, std::vector<warp_vertex_t>> _texts;
+};
@@ -0,0 +1,124 @@
+#define WARP_DROP_PREFIX
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+#include "warp/utils/log.h"
+
+static const size_t TRACE_RING_SIZE = 64 * 1024; /* events per thread */
+static const char *EXIT_TRACE_PATH = "trace.json";
+
+struct trace_event_t {
+    const char *name;
+    uint64_t timestamp; /* microseconds since first event */
+    char phase;         /* 'B' or 'E', as in the trace format */
+};
+
+/* Written only by its thread, head is published after the event, so
+ * export sees whole events unless the ring wraps while reading. */
+struct trace_ring_t {
+    std::atomic<uint64_t> head;
+    uint32_t thread_id;
+    trace_event_t events[TRACE_RING_SIZE];
+};
+
+/* rings are never freed, events of finished threads are still exported */
+static std::mutex rings_mutex;
+static std::vector<trace_ring_t *> rings;
+static thread_local trace_ring_t *local_ring = NULL;
+
+static const std::chrono::steady_clock::time_point trace_start
+    = std::chrono::steady_clock::now();
+
+static void export_at_exit(void) {
+    trace_export(EXIT_TRACE_PATH);
+}
+
+static trace_ring_t *create_ring(void) {
+    trace_ring_t *ring = new trace_ring_t;
+    ring->head.store(0, std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(rings_mutex);
+    if (rings.empty()) {
+        atexit(export_at_exit);
+    }
+    ring->thread_id = rings.size();
+    rings.push_back(ring);
+    return ring;
+}
+
+static void record(const char *name, char phase) {
+    if (local_ring == NULL) {
+        local_ring = create_ring();
+    }
+    const auto now = std::chrono::steady_clock::now();
+    const auto elapsed
+        = std::chrono::duration_cast<std::chrono::microseconds>(now - trace_start);
+
+    trace_ring_t *ring = local_ring;
+    const uint64_t head = ring->head.load(std::memory_order_relaxed);
+    trace_event_t *event = ring->events + head % TRACE_RING_SIZE;
+    event->name = name;
+    event->timestamp = elapsed.count();
+    event->phase = phase;
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+extern "C" void trace_begin(const char *name) {
+    record(name, 'B');
+}
+
+extern "C" void trace_end(void) {
+    record(NULL, 'E');
+}
+
+static void write_name(FILE *file, const char *name) {
+    for (const char *c = name; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\') {
+            fputc('\\', file);
+        }
+        fputc(*c, file);
+    }
+}
+
+extern "C" void trace_export(const char *path) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        warp_log_e("Failed to open trace file: '%s'.", path);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(rings_mutex);
+    size_t count = 0;
+    fputs("{\"traceEvents\":[\n", file);
+    for (trace_ring_t *ring : rings) {
+        const uint64_t head = ring->head.load(std::memory_order_acquire);
+        const uint64_t first = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+        for (uint64_t i = first; i < head; i++) {
+            const trace_event_t *event = ring->events + i % TRACE_RING_SIZE;
+            fputs(count == 0 ? "" : ",\n", file);
+            fprintf( file, "{\"ph\":\"%c\",\"pid\":0,\"tid\":%u,\"ts\":%llu"
+                   , event->phase, ring->thread_id
+                   , (unsigned long long)event->timestamp
+                   );
+            if (event->name != NULL) {
+                fputs(",\"name\":\"", file);
+                write_name(file, event->name);
+                fputc('"', file);
+            }
+            fputc('}', file);
+            count += 1;
+        }
+    }
+    fputs("\n]}\n", file);
+    fclose(file);
+
+    warp_log_d("Written %zu trace events to: '%s'.", count, path);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+/* Trace scopes record begin and end events into a per-thread ring, rings
+ * are written out as Chrome trace_event JSON (chrome://tracing).
+ *
+ * Scopes compile to nothing unless TRACING is defined, configure with
+ * -DENABLE_TRACING=ON to get them. Names must outlive the export, string
+ * literals are expected. */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void trace_begin(const char *name);
+void trace_end(void);
+/* Writes all recorded events, safe to call while other threads record: */
+void trace_export(const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef TRACING
+#define TRACE_BEGIN(name) trace_begin(name)
+#define TRACE_END() trace_end()
+#else
+#define TRACE_BEGIN(name) ((void)0)
+#define TRACE_END() ((void)0)
+#endif
+
+#ifdef __cplusplus
+
+class trace_scope_t {
+    public:
+        explicit trace_scope_t(const char *name) { trace_begin(name); }
+        ~trace_scope_t() { trace_end(); }
+
+        trace_scope_t(const trace_scope_t &) = delete;
+        trace_scope_t &operator=(const trace_scope_t &) = delete;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a ## b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+#ifdef TRACING
+#define TRACE_SCOPE(name) trace_scope_t TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#else
+#define TRACE_SCOPE(name) ((void)0)
+#endif
+
+#endif
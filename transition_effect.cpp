@@ -1,6 +1,8 @@
 #define WARP_DROP_PREFIX
 #include "transition_effect.h"
 
+#include <cstring>
+
 #include "warp/math/mat4.h"
 #include "warp/math/utils.h"
 #include "warp/world.h"
@@ -8,6 +10,8 @@
 #include "warp/graphics/mesh.h"
 #include "warp/graphics/mesh-loader.h"
 
+#include "entities.h"
+
 using namespace warp;
 
 static const size_t CIRCLE_SIDES = 24;
@@ -46,6 +50,27 @@ static void tessellate(vertex_t *buffer, float out_radius, float in_radius) {
     }
 }
 
+/* Faders share one ring of unit inner radius, scaling it moves the inner
+ * edge. The outer edge is far enough to still cover the screen when the
+ * hole is under a pixel wide. */
+static const char *RING_MESH_NAME = "fader-ring";
+static const float RING_OUT_RADIUS = 4096.0f;
+static const float MIN_HOLE_RADIUS = 0.25f;
+
+static res_id_t get_ring_mesh(resources_t *res) {
+    res_id_t mesh_id = resources_lookup(res, RING_MESH_NAME);
+    if (mesh_id != WARP_RES_ID_INVALID) {
+        return mesh_id;
+    }
+
+    const size_t count = CIRCLE_SIDES * 6;
+    vertex_t vertices[count];
+    memset(vertices, 0, sizeof vertices);
+    tessellate(vertices, RING_OUT_RADIUS, 1.0f);
+
+    return warp_mesh_resource_from_buffer(res, RING_MESH_NAME, vertices, count);
+}
+
 class fade_circle_controller_t final : public controller_impl_i {
     public:
         fade_circle_controller_t
@@ -54,7 +79,8 @@ class fade_circle_controller_t final : public controller_impl_i {
               , _duration(duration)
               , _timer(duration)
               , _fade_in(fade_in)
-              , _mesh_id(0)
+              , _hole_radius(-1)
+              , _destroyed(false)
         {}
 
         dynval_t get_property(const warp_tag_t &) const override {
@@ -65,12 +91,21 @@ class fade_circle_controller_t final : public controller_impl_i {
             _owner = owner;
             _world = world;
 
-            recreate_mesh(_fade_in ? 1 : 0);
+            resources_t *res = _world->get_resources();
+            const res_id_t mesh_id = get_ring_mesh(res);
+            const res_id_t tex_id = resources_lookup(res, "missing.png");
+
+            model_init(&_model, mesh_id, tex_id);
+            _model.color = vec4(0, 0, 0, 1);
+            _owner->receive_message(MSG_GRAPHICS_ADD_MODEL, &_model);
+
+            change_hole(_fade_in ? 1 : 0);
         }
 
         void update(float dt, const input_t &) override { 
-            if (_timer <= 0 && _fade_in == false) {
-                _world->destroy_later(_owner);
+            if (_timer <= 0 && _fade_in == false && _destroyed == false) {
+                destroy_game_entity(_world, _owner);
+                _destroyed = true;
             }
             if (_timer > 0) {
                 _timer -= dt;
@@ -78,25 +113,11 @@ class fade_circle_controller_t final : public controller_impl_i {
             
             const float t = ease_cubic(_timer / _duration);
             const float k = _fade_in ? t : 1 - t;
-            recreate_mesh(k);
+            change_hole(k);
         }
 
         void handle_message(const message_t &) override { }
 
-        void recreate_mesh(float k) {
-            const size_t count = CIRCLE_SIDES * 6;
-            vertex_t *vertices = (vertex_t *) malloc(count * sizeof *vertices);
-
-            tessellate(vertices, _out_radius, k * _out_radius);
-            
-            if (_mesh_id == 0) {
-                add_new_mesh(vertices, count);
-            } else {
-                mutate_mesh(vertices, count);
-            }
-            free(vertices);
-        }
-
     private:
         world_t  *_world;
         entity_t *_owner;
@@ -105,25 +126,20 @@ class fade_circle_controller_t final : public controller_impl_i {
         float _duration;
         float _timer;
         bool _fade_in;
-        res_id_t _mesh_id;
+        float _hole_radius;
+        bool _destroyed;
 
         model_t _model;
 
-        void add_new_mesh(vertex_t *vertices, size_t count) {
-            resources_t *res = _world->get_resources();
-
-            _mesh_id = warp_mesh_resource_from_buffer(res, "fader", vertices, count);
-            res_id_t tex_id = resources_lookup(res, "missing.png");
-
-            model_init(&_model, _mesh_id, tex_id);
-            _model.color = vec4(0, 0, 0, 1);
-            
-            _owner->receive_message(MSG_GRAPHICS_ADD_MODEL, &_model);
-        }
+        void change_hole(float k) {
+            float radius = k * _out_radius;
+            if (radius < MIN_HOLE_RADIUS) {
+                radius = MIN_HOLE_RADIUS;
+            }
+            if (radius == _hole_radius) return;
 
-        void mutate_mesh(vertex_t *vertices, size_t count) {
-            resources_t *res = _world->get_resources();
-            warp_mesh_resource_mutate(res, _mesh_id, vertices, count);
+            _hole_radius = radius;
+            _owner->receive_message(MSG_PHYSICS_SCALE, vec3(radius, radius, 1));
         }
 };
 
@@ -137,7 +153,8 @@ entity_t *create_fade_circle
     graphics->remove_pass_tags();
     graphics->add_pass_tag(WARP_TAG("ui"));
 
-    entity_t *entity = world->create_entity(vec3(0, 0, 0), graphics, NULL, controller);
+    entity_t *entity
+        = create_game_entity(world, vec3(0, 0, 0), graphics, NULL, controller);
     entity->set_tag(WARP_TAG("fade_circle"));
 
     return entity;
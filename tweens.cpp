@@ -0,0 +1,230 @@
+#define WARP_DROP_PREFIX
+#include "tweens.h"
+
+#include <math.h>
+
+#include "warp/math/utils.h"
+#include "warp/world.h"
+#include "warp/entity.h"
+#include "warp/components.h"
+
+#include "entities.h"
+#include "perf.h"
+#include "trace.h"
+
+using namespace warp;
+
+static const size_t NOT_FOUND = (size_t)-1;
+
+static float get_weight(tween_curve_t curve, float u) {
+    switch (curve) {
+        case TWEEN_LINEAR:      return u;
+        case TWEEN_QUAD_OUT:    return u * (2 - u);
+        case TWEEN_CUBIC:       return ease_cubic(u);
+        case TWEEN_CUBIC_OUT:   return 1 - ease_cubic(1 - u);
+        case TWEEN_ELASTIC:     return ease_elastic(u);
+        case TWEEN_ELASTIC_OUT: return 1 - ease_elastic(1 - u);
+        case TWEEN_SINE_IN:     return 1 - cosf(u * PI * 0.5f);
+        case TWEEN_PULSE:       return sinf(u * PI);
+        case TWEEN_WAVE:        return sinf(u * 2 * PI);
+        case TWEEN_HOP:         return fabsf(sinf(u * 2 * PI));
+        default: return u;
+    }
+}
+
+static void send_value(entity_t *entity, tween_channel_t channel, vec3_t value) {
+    switch (channel) {
+        case TWEEN_POSITION:
+            entity->receive_message(MSG_PHYSICS_MOVE, value);
+            break;
+        case TWEEN_SCALE:
+            entity->receive_message(MSG_PHYSICS_SCALE, value);
+            break;
+        case TWEEN_YAW:
+            entity->receive_message(MSG_PHYSICS_ROTATE, quat_from_euler(0, value.x, 0));
+            break;
+    }
+}
+
+size_t tween_system_t::find(const entity_t *entity, tween_channel_t channel) const {
+    const size_t count = _entities.size();
+    for (size_t i = 0; i < count; i++) {
+        if (_entities[i] == entity && _channels[i] == channel) {
+            return i;
+        }
+    }
+    return NOT_FOUND;
+}
+
+/* order of tweens does not matter, the last one takes the free slot */
+void tween_system_t::remove(size_t index) {
+    const size_t last = _entities.size() - 1;
+    if (index != last) {
+        _entities[index] = _entities[last];
+        _channels[index] = _channels[last];
+        _curves[index] = _curves[last];
+        _y_curves[index] = _y_curves[last];
+        _from[index] = _from[last];
+        _delta[index] = _delta[last];
+        _durations[index] = _durations[last];
+        _elapsed[index] = _elapsed[last];
+        _callbacks[index] = std::move(_callbacks[last]);
+    }
+    _entities.pop_back();
+    _channels.pop_back();
+    _curves.pop_back();
+    _y_curves.pop_back();
+    _from.pop_back();
+    _delta.pop_back();
+    _durations.pop_back();
+    _elapsed.pop_back();
+    _callbacks.pop_back();
+}
+
+void tween_system_t::start(entity_t *entity, const tween_def_t &def, callback_t done) {
+    const size_t index = find(entity, def.channel);
+    if (index == NOT_FOUND) {
+        _entities.push_back(entity);
+        _channels.push_back(def.channel);
+        _curves.push_back(def.curve);
+        _y_curves.push_back(def.y_curve);
+        _from.push_back(def.from);
+        _delta.push_back(vec3_sub(def.to, def.from));
+        _durations.push_back(def.duration);
+        _elapsed.push_back(0);
+        _callbacks.push_back(std::move(done));
+        return;
+    }
+
+    _curves[index] = def.curve;
+    _y_curves[index] = def.y_curve;
+    _from[index] = def.from;
+    _delta[index] = vec3_sub(def.to, def.from);
+    _durations[index] = def.duration;
+    _elapsed[index] = 0;
+    _callbacks[index] = std::move(done);
+}
+
+void tween_system_t::stop(entity_t *entity, tween_channel_t channel) {
+    const size_t index = find(entity, channel);
+    if (index != NOT_FOUND) {
+        remove(index);
+    }
+}
+
+void tween_system_t::stop_all(entity_t *entity) {
+    for (size_t i = 0; i < _entities.size();) {
+        if (_entities[i] == entity) {
+            remove(i);
+        } else {
+            i++;
+        }
+    }
+    for (auto it = _waiters.begin(); it != _waiters.end();) {
+        it = it->entity == entity ? _waiters.erase(it) : it + 1;
+    }
+}
+
+bool tween_system_t::is_running(const entity_t *entity, tween_channel_t channel) const {
+    return find(entity, channel) != NOT_FOUND;
+}
+
+bool tween_system_t::when_finished
+        (entity_t *entity, tween_channel_t channel, callback_t callback) {
+    if (is_running(entity, channel) == false) return false;
+
+    waiter_t waiter = { entity, channel, std::move(callback) };
+    _waiters.push_back(std::move(waiter));
+    return true;
+}
+
+void tween_system_t::update(float dt) {
+    TRACE_SCOPE("tween_system_t::update");
+    const size_t count = _entities.size();
+    if (count == 0 && _waiters.empty()) return;
+    PERF_ADD(PERF_TWEENS, count);
+
+    _progress.resize(count);
+    _weights.resize(count);
+    _y_weights.resize(count);
+    _values.resize(count);
+
+    /* plain loops over packed arrays, only the curves branch */
+    for (size_t i = 0; i < count; i++) {
+        _elapsed[i] += dt;
+        const float u = _durations[i] > 0 ? _elapsed[i] / _durations[i] : 1;
+        _progress[i] = u < 1 ? u : 1;
+    }
+    for (size_t i = 0; i < count; i++) {
+        _weights[i] = get_weight(_curves[i], _progress[i]);
+        _y_weights[i] = get_weight(_y_curves[i], _progress[i]);
+    }
+    for (size_t i = 0; i < count; i++) {
+        _values[i].x = _from[i].x + _delta[i].x * _weights[i];
+        _values[i].y = _from[i].y + _delta[i].y * _y_weights[i];
+        _values[i].z = _from[i].z + _delta[i].z * _weights[i];
+    }
+    for (size_t i = 0; i < count; i++) {
+        send_value(_entities[i], _channels[i], _values[i]);
+    }
+
+    /* callbacks may start and stop tweens, they run after the arrays settle */
+    for (size_t i = count; i > 0; i--) {
+        if (_progress[i - 1] < 1) continue;
+        if (_callbacks[i - 1] != nullptr) {
+            _finished.push_back(std::move(_callbacks[i - 1]));
+        }
+        remove(i - 1);
+    }
+    for (size_t i = 0; i < _finished.size(); i++) {
+        _finished[i]();
+    }
+    _finished.clear();
+
+    for (size_t i = 0; i < _waiters.size();) {
+        if (is_running(_waiters[i].entity, _waiters[i].channel)) {
+            i++;
+            continue;
+        }
+        callback_t callback = std::move(_waiters[i].callback);
+        _waiters.erase(_waiters.begin() + i);
+        callback();
+    }
+}
+
+class tweens_controller_t final : public controller_impl_i {
+    public:
+        tweens_controller_t()
+            : _tweens(std::make_shared<tween_system_t>())
+        {}
+
+        dynval_t get_property(const warp_tag_t &name) const override {
+            if (warp_tag_equals_buffer(&name, "tweens")) {
+                return (void *)_tweens.get();
+            }
+            return dynval_t::make_null();
+        }
+
+        void initialize(entity_t *, world_t *) override { }
+
+        void update(float dt, const input_t &) override {
+            _tweens->update(dt);
+        }
+
+        void handle_message(const message_t &) override { }
+
+    private:
+        std::shared_ptr<tween_system_t> _tweens;
+};
+
+extern tween_system_t *get_tweens(world_t *world) {
+    entity_t *entity = world->find_entity(WARP_TAG("tweens"));
+    if (entity == nullptr) {
+        controller_comp_t *controller = world->create_controller();
+        controller->initialize(new tweens_controller_t);
+
+        entity = create_game_entity(world, vec3(0, 0, 0), NULL, NULL, controller);
+        entity->set_tag(WARP_TAG("tweens"));
+    }
+    return (tween_system_t *)entity->get_property(WARP_TAG("tweens")).get_pointer();
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <functional>
+
+#include "warp/math/vec3.h"
+
+namespace warp {
+    class entity_t;
+    class world_t;
+}
+
+/* Animated entity property, each entity runs at most one tween per channel: */
+enum tween_channel_t : unsigned char {
+    TWEEN_POSITION, /* sent as MSG_PHYSICS_MOVE */
+    TWEEN_SCALE,    /* sent as MSG_PHYSICS_SCALE */
+    TWEEN_YAW,      /* x is the angle around y axis, sent as MSG_PHYSICS_ROTATE */
+};
+
+/* Weight of the end value at progress u, _OUT curves are mirrored so they
+ * settle at the end instead of leaving the start: */
+enum tween_curve_t : unsigned char {
+    TWEEN_LINEAR,
+    TWEEN_QUAD_OUT,    /* decelerates to a stop */
+    TWEEN_CUBIC,
+    TWEEN_CUBIC_OUT,
+    TWEEN_ELASTIC,
+    TWEEN_ELASTIC_OUT,
+    TWEEN_SINE_IN,     /* quarter of a cosine, accelerates from a stop */
+    TWEEN_PULSE,       /* half of a sine, goes to the end value and back */
+    TWEEN_WAVE,        /* full sine, past the start value and back */
+    TWEEN_HOP,         /* two pulses */
+};
+
+struct tween_def_t {
+    tween_channel_t channel;
+    tween_curve_t curve;
+    tween_curve_t y_curve; /* y moves on its own curve, for jumps and falls */
+    warp_vec3_t from;
+    warp_vec3_t to;
+    float duration;
+};
+
+/* Runs all animations of the world in one pass over packed arrays, instead
+ * of every controller ticking its own timer. Entities with running tweens
+ * must stop them before they are destroyed, see stop_all. */
+class tween_system_t final : public std::enable_shared_from_this<tween_system_t> {
+    public:
+        typedef std::function<void(void)> callback_t;
+
+        /* replaces tween running on the same channel, without calling its
+         * callback; done is called after the end value is sent */
+        void start(warp::entity_t *entity, const tween_def_t &def, callback_t done = nullptr);
+        void stop(warp::entity_t *entity, tween_channel_t channel);
+        void stop_all(warp::entity_t *entity);
+        bool is_running(const warp::entity_t *entity, tween_channel_t channel) const;
+
+        /* Calls back once the channel is idle, restarted tweens are waited
+         * for too. Returns false and drops callback if it is already idle. */
+        bool when_finished
+            (warp::entity_t *entity, tween_channel_t channel, callback_t callback);
+
+        void update(float dt);
+
+    private:
+        struct waiter_t {
+            warp::entity_t *entity;
+            tween_channel_t channel;
+            callback_t callback;
+        };
+
+        /* structure of arrays, one index per running tween */
+        std::vector<warp::entity_t *> _entities;
+        std::vector<tween_channel_t> _channels;
+        std::vector<tween_curve_t> _curves;
+        std::vector<tween_curve_t> _y_curves;
+        std::vector<warp_vec3_t> _from;
+        std::vector<warp_vec3_t> _delta;
+        std::vector<float> _durations;
+        std::vector<float> _elapsed;
+        std::vector<callback_t> _callbacks;
+
+        /* scratch buffers of update, kept to avoid allocations */
+        std::vector<float> _progress;
+        std::vector<float> _weights;
+        std::vector<float> _y_weights;
+        std::vector<warp_vec3_t> _values;
+        std::vector<callback_t> _finished;
+
+        std::vector<waiter_t> _waiters;
+
+        size_t find(const warp::entity_t *entity, tween_channel_t channel) const;
+        void remove(size_t index);
+};
+
+/* Created on first use with the state, pointers to it stay valid until the
+ * state changes: */
+tween_system_t *get_tweens(warp::world_t *world);